@@ -0,0 +1,97 @@
+#include "AngleStore.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    constexpr size_t header_size = 8 + 8 + 8 + 8;
+}
+
+AngleSumWriter::AngleSumWriter(const std::string &path, double dt)
+    : path(path), file(std::fopen(path.c_str(), "wb")), dt(dt) {
+    if (file) {
+        // header is written by Finish() once the number of samples is known
+        char header[header_size] = {};
+        std::fwrite(header, 1, header_size, file);
+        std::fwrite(&sum, sizeof(sum), 1, file);
+    }
+}
+
+AngleSumWriter::~AngleSumWriter() {
+    if (file) {
+        std::fclose(file);
+    }
+}
+
+void AngleSumWriter::Add(double t, float angle) {
+    if (n == 0) {
+        t0 = t;
+    }
+    sum += angle;
+    n++;
+    if (file) {
+        std::fwrite(&sum, sizeof(sum), 1, file);
+    }
+}
+
+bool AngleSumWriter::Finish() {
+    bool ok = file != nullptr;
+    if (ok) {
+        std::fseek(file, 0, SEEK_SET);
+        std::fwrite("ANGLESUM", 1, 8, file);
+        std::fwrite(&t0, sizeof(t0), 1, file);
+        std::fwrite(&dt, sizeof(dt), 1, file);
+        std::fwrite(&n, sizeof(n), 1, file);
+        ok = std::fclose(file) == 0;
+        file = nullptr;
+    }
+    if (!ok) {
+        std::cerr << "Unable to write '" << path << "'" << std::endl;
+    }
+    return ok;
+}
+
+AngleSums::AngleSums(int fd) : map(fd) {
+    const uint8_t *p = map.Data();
+    if (map.Size() < header_size + sizeof(double) || memcmp(p, "ANGLESUM", 8) != 0) {
+        throw std::runtime_error("not an angle sum file");
+    }
+    memcpy(&t0, p + 8, sizeof(t0));
+    memcpy(&dt, p + 16, sizeof(dt));
+    memcpy(&n, p + 24, sizeof(n));
+    if (map.Size() < header_size + (n + 1) * sizeof(double)) {
+        throw std::runtime_error("truncated angle sum file");
+    }
+    sums = reinterpret_cast<const double *>(p + header_size);
+}
+
+void ClassifyWindows(const AngleSums &sums, const WindowConfig &config,
+                     const std::function<void(double, uint8_t)> &emit) {
+    // count of changes above the threshold within the history, kept up to
+    // date with a ring buffer so each window is O(1)
+    std::vector<bool> above(config.history, false);
+    size_t pos = 0, count = 0;
+    bool have_mean = false;
+    double mean_d = 0;
+
+    const uint64_t w = config.window;
+    for (uint64_t i = 0; i < sums.Samples(); i += w) {
+        // the model's angle history starts out as zeros
+        uint64_t first = i + 1 >= w ? i + 1 - w : 0;
+        double mean = sums.Sum(first, i + 1) / w;
+
+        if (have_mean) {
+            bool change = std::fabs(mean - mean_d) > config.threshold;
+            count += change;
+            count -= above[pos];
+            above[pos] = change;
+            pos = (pos + 1) % above.size();
+            emit(sums.Time(i), count == 0 ? 1 : 0);
+        }
+        mean_d = mean;
+        have_mean = true;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+/*
+ * Column store of per-sample arm angles as prefix sums, so the mean angle of
+ * any run of samples is one subtraction. The arm angle only depends on the
+ * moving average, not on the window length, so window-length sweeps can run
+ * from this file without the accelerometer data.
+ *
+ * File layout, little-endian:
+ *
+ *   char     magic[8]   "ANGLESUM"
+ *   float64  t0         time of the first sample
+ *   float64  dt         sample period
+ *   uint64   n          number of samples
+ *   float64  sum[n + 1] sum[i] is the sum of the first i angles
+ */
+class AngleSumWriter {
+public:
+    AngleSumWriter(const std::string &path, double dt);
+    ~AngleSumWriter();
+
+    AngleSumWriter(const AngleSumWriter &) = delete;
+    AngleSumWriter &operator=(const AngleSumWriter &) = delete;
+
+    void Add(double t, float angle);
+
+    // Returns false and prints an error on failure.
+    bool Finish();
+
+private:
+    std::string path;
+    std::FILE *file;
+    double dt;
+    double t0 = 0;
+    uint64_t n = 0;
+    double sum = 0;
+};
+
+class AngleSums {
+public:
+    // Takes ownership of <fd>. Throws std::runtime_error if it is not an
+    // angle sum file.
+    explicit AngleSums(int fd);
+
+    uint64_t Samples() const { return n; }
+    double Time(uint64_t i) const { return t0 + i * dt; }
+    double SamplePeriod() const { return dt; }
+
+    // Sum of the angles of samples [i, j).
+    double Sum(uint64_t i, uint64_t j) const { return sums[j] - sums[i]; }
+
+private:
+    MappedFile map;
+    const double *sums;
+    double t0, dt;
+    uint64_t n;
+};
+
+struct WindowConfig {
+    uint64_t window;  // samples per window
+    uint64_t history;  // windows of angle changes considered
+    float threshold;  // degrees
+};
+
+// Run the decision stage of VanHeesModel for one window length from the
+// stored angles, in O(1) per window. <emit> is called with the time and state
+// of every classified window.
+void ClassifyWindows(const AngleSums &sums, const WindowConfig &config,
+                     const std::function<void(double, uint8_t)> &emit);
@@ -0,0 +1,228 @@
+#include "Cohort.h"
+#include "SampleSource.h"
+#include "Trace.h"
+
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <system_error>
+
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Identifies the build, so a rebuilt tracker never reuses old results.
+    Hash128 BuildId() {
+        Hasher hasher;
+        if (!HashFile("/proc/self/exe", hasher)) {
+            hasher.Update(__DATE__ " " __TIME__);
+        }
+        return hasher.Final();
+    }
+
+    // Add the content of one input to the key. Returns false for inputs that
+    // cannot be addressed by content.
+    bool HashInput(const std::string &spec, Hasher &hasher) {
+        std::string type, location;
+        SplitSourceSpec(spec, type, location);
+
+        if (type == "synth") {
+            hasher.Update(spec);
+            return true;
+        }
+        if (type == "unix" || type == "tcp" || location == "-") {
+            return false;
+        }
+        hasher.Update(type);
+        return HashFile(location, hasher);
+    }
+
+    bool NightKey(const Night &night, const Hash128 &config, const Hash128 &build, Hash128 &key) {
+        Hasher hasher;
+        hasher.Update(config);
+        hasher.Update(build);
+        for (const std::string &input : night.inputs) {
+            if (!HashInput(input, hasher)) {
+                return false;
+            }
+        }
+        key = hasher.Final();
+        return true;
+    }
+
+    // The meta file is written after the result, so its presence marks a
+    // complete cache entry.
+    bool ReadMeta(const fs::path &path, double &seconds) {
+        std::ifstream in(path);
+        std::string field;
+        return in >> field >> seconds && field == "seconds";
+    }
+
+    // Temporary name for <path> while process <pid> writes it. Unique per
+    // process, as workers may share a cache.
+    fs::path Temporary(const fs::path &path, pid_t pid) {
+        fs::path tmp = path;
+        tmp += "." + std::to_string(pid) + ".tmp";
+        return tmp;
+    }
+
+    // Copy via a temporary file, so readers never see a partial result.
+    bool CopyResult(const fs::path &from, const fs::path &to) {
+        fs::path tmp = Temporary(to, getpid());
+        std::error_code ec;
+        fs::copy_file(from, tmp, fs::copy_options::overwrite_existing, ec);
+        if (!ec) {
+            fs::rename(tmp, to, ec);
+        }
+        if (ec) {
+            std::cerr << "Unable to copy '" << from.string() << "' to '" << to.string() << "': "
+                      << ec.message() << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+bool LoadCohort(const char *path, std::vector<Night> &nights) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Unable to open '" << path << "'" << std::endl;
+        return false;
+    }
+
+    std::string line;
+    for (int n = 1; std::getline(in, line); n++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        Night night;
+        if (!(fields >> night.name)) {
+            continue;
+        }
+        for (std::string input; fields >> input;) {
+            night.inputs.push_back(input);
+        }
+        if (night.inputs.empty() || night.name.find('/') != std::string::npos) {
+            std::cerr << path << ":" << n << ": expected NAME INPUT..." << std::endl;
+            return false;
+        }
+        nights.push_back(night);
+    }
+    return true;
+}
+
+CohortRunner::CohortRunner(const std::string &out_dir, const std::string &cache_dir, const Hash128 &config,
+                           ReplayNight replay)
+    : out_dir(out_dir), cache_dir(cache_dir), config(config), build(BuildId()), replay(std::move(replay)) {}
+
+bool CohortRunner::Prepare() const {
+    std::error_code ec;
+    fs::create_directories(out_dir, ec);
+    if (!ec && !cache_dir.empty()) {
+        fs::create_directories(cache_dir, ec);
+    }
+    if (ec) {
+        std::cerr << "Unable to create output directories: " << ec.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+NightResult CohortRunner::Run(const Night &night) const {
+    TraceSpan span("night");
+    NightResult r;
+    fs::path result = fs::path(out_dir) / (night.name + ".txt");
+    Hash128 key;
+    bool cacheable = !cache_dir.empty() && NightKey(night, config, build, key);
+    fs::path cached = cacheable ? fs::path(cache_dir) / (key.Hex() + ".txt") : fs::path();
+    fs::path meta = cacheable ? fs::path(cache_dir) / (key.Hex() + ".meta") : fs::path();
+    r.key = cacheable ? key.Hex() : "-";
+
+    if (cacheable && ReadMeta(meta, r.seconds) && CopyResult(cached, result)) {
+        r.ok = r.hit = true;
+        return r;
+    }
+
+    fs::path tmp = Temporary(result, getpid());
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::ofstream out(tmp);
+        try {
+            r.ok = out && replay(night, out);
+            r.ok = r.ok && out.flush();
+        } catch (const std::exception &e) {
+            std::cerr << "Night '" << night.name << "': " << e.what() << std::endl;
+            r.ok = false;
+        }
+    }
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::error_code ec;
+    if (r.ok) {
+        fs::rename(tmp, result, ec);
+        if (ec) {
+            std::cerr << "Unable to write '" << result.string() << "': " << ec.message() << std::endl;
+            r.ok = false;
+        }
+    }
+    if (!r.ok) {
+        std::cerr << "Night '" << night.name << "' failed" << std::endl;
+        fs::remove(tmp, ec);
+        return r;
+    }
+
+    if (cacheable && CopyResult(result, cached)) {
+        std::ofstream(meta) << "seconds " << r.seconds << std::endl;
+    }
+    return r;
+}
+
+void CohortRunner::RemoveTemporaries(const Night &night, pid_t pid) const {
+    std::error_code ec;
+    fs::remove(Temporary(fs::path(out_dir) / (night.name + ".txt"), pid), ec);
+    Hash128 key;
+    if (!cache_dir.empty() && NightKey(night, config, build, key)) {
+        fs::remove(Temporary(fs::path(cache_dir) / (key.Hex() + ".txt"), pid), ec);
+    }
+}
+
+bool WriteManifest(const std::vector<Night> &nights, const std::vector<NightResult> &results,
+                   const std::string &out_dir, CohortStats &stats) {
+    std::ofstream manifest(fs::path(out_dir) / "manifest.txt");
+    manifest << "# NAME KEY RESULT SECONDS" << std::endl;
+
+    bool ok = true;
+    for (size_t i = 0; i < nights.size(); i++) {
+        const NightResult &r = results[i];
+        stats.nights++;
+        if (r.hit) {
+            stats.hits++;
+            stats.saved_seconds += r.seconds;
+        } else {
+            stats.replay_seconds += r.seconds;
+        }
+        ok &= r.ok;
+        manifest << nights[i].name << " " << r.key << " " << (!r.ok ? "failed" : r.hit ? "hit" : "miss")
+                 << " " << r.seconds << std::endl;
+    }
+
+    double rate = stats.nights ? 100.0 * stats.hits / stats.nights : 0;
+    manifest << "# nights " << stats.nights << ", hits " << stats.hits << " (" << rate << " %)"
+             << ", replayed " << stats.replay_seconds << " s, saved " << stats.saved_seconds << " s" << std::endl;
+    return ok && manifest.flush();
+}
+
+bool RunCohort(const std::vector<Night> &nights, const CohortRunner &runner, const std::string &out_dir,
+               CohortStats &stats) {
+    if (!runner.Prepare()) {
+        return false;
+    }
+    std::vector<NightResult> results;
+    for (const Night &night : nights) {
+        results.push_back(runner.Run(night));
+    }
+    return WriteManifest(nights, results, out_dir, stats);
+}
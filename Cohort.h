@@ -0,0 +1,82 @@
+#pragma once
+
+#include "ContentHash.h"
+
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+/*
+ * Cohort runs: one tracker replay per night, each written to its own result
+ * file. Results are cached by content: a night's key hashes its input files,
+ * the effective tracker configuration and the build of this binary, so
+ * re-running a cohort after a change only replays the nights it affects.
+ * Nights read from sockets or stdin are always replayed.
+ *
+ * Cache layout, in the cache directory:
+ *
+ *   KEY.txt   the result file
+ *   KEY.meta  "seconds S", the time the replay took
+ */
+
+struct Night {
+    std::string name;
+    std::vector<std::string> inputs;  // TYPE:LOCATION specs as on the command line
+};
+
+// Read a cohort list, one night per line as NAME INPUT..., with '#' starting
+// a comment. Returns false and prints an error on failure.
+bool LoadCohort(const char *path, std::vector<Night> &nights);
+
+// Replays one night, writing its result to <out>. Returns false on failure.
+using ReplayNight = std::function<bool(const Night &night, std::ostream &out)>;
+
+struct NightResult {
+    bool ok = false;
+    bool hit = false;
+    std::string key = "-";  // "-" if the night is not cached
+    double seconds = 0;  // replay time, also for hits
+};
+
+// Runs single nights of a cohort into OUT_DIR/NAME.txt, through the cache in
+// <cache_dir> unless it is empty.
+class CohortRunner {
+public:
+    CohortRunner(const std::string &out_dir, const std::string &cache_dir, const Hash128 &config,
+                 ReplayNight replay);
+
+    // Create the directories. Returns false and prints an error on failure.
+    bool Prepare() const;
+
+    NightResult Run(const Night &night) const;
+
+    // Remove the temporary files that process <pid> may have left behind if
+    // it died while running <night>.
+    void RemoveTemporaries(const Night &night, pid_t pid) const;
+
+private:
+    std::string out_dir, cache_dir;
+    Hash128 config;
+    Hash128 build;
+    ReplayNight replay;
+};
+
+struct CohortStats {
+    size_t nights = 0;
+    size_t hits = 0;
+    double replay_seconds = 0;  // spent replaying misses
+    double saved_seconds = 0;  // the replays of the hits took this long originally
+};
+
+// Write OUT_DIR/manifest.txt with the key, hit or miss and time of each night,
+// and add them up in <stats>. Returns false if a night failed.
+bool WriteManifest(const std::vector<Night> &nights, const std::vector<NightResult> &results,
+                   const std::string &out_dir, CohortStats &stats);
+
+// Run every night in turn and write the manifest. Returns false if a night
+// failed; the others are still run.
+bool RunCohort(const std::vector<Night> &nights, const CohortRunner &runner, const std::string &out_dir,
+               CohortStats &stats);
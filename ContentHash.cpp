@@ -0,0 +1,72 @@
+#include "ContentHash.h"
+#include "MappedFile.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+
+namespace {
+    uint64_t Rotl(uint64_t x, int r) {
+        return x << r | x >> (64 - r);
+    }
+
+    // MurmurHash3 finalizer
+    uint64_t Avalanche(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccd;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53;
+        x ^= x >> 33;
+        return x;
+    }
+}
+
+std::string Hash128::Hex() const {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(32, '0');
+    for (int i = 0; i < 16; i++) {
+        hex[15 - i] = digits[(hi >> (4 * i)) & 0xf];
+        hex[31 - i] = digits[(lo >> (4 * i)) & 0xf];
+    }
+    return hex;
+}
+
+void Hasher::Mix(uint64_t word) {
+    a = Rotl((a ^ word) * 0x87c37b91114253d5, 31);
+    b = Rotl((b ^ word) * 0x4cf5ad432745937f, 33);
+}
+
+void Hasher::Update(const void *data, size_t size) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, p + i, 8);
+        Mix(word);
+    }
+    uint64_t tail = 0;
+    if (i < size) {
+        memcpy(&tail, p + i, size - i);
+    }
+    Mix(tail);
+    Mix(size);
+}
+
+Hash128 Hasher::Final() const {
+    uint64_t x = a + b, y = a ^ Rotl(b, 17);
+    return {Avalanche(x), Avalanche(y + x)};
+}
+
+bool HashFile(const std::string &path, Hasher &hasher) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    try {
+        MappedFile map(fd);
+        hasher.Update(map.Data(), map.Size());
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+    return true;
+}
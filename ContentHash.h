@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+ * 128-bit content hash for cache keys. Two multiply-rotate lanes run over
+ * 8-byte words, so hashing a memory-mapped input runs at several GB/s; it is
+ * not a cryptographic hash and not compatible with any standard one. Every
+ * Update() is length-terminated, so a key built from several fields does not
+ * depend on where one field ends and the next begins.
+ */
+struct Hash128 {
+    uint64_t hi = 0, lo = 0;
+
+    std::string Hex() const;
+};
+
+class Hasher {
+public:
+    void Update(const void *data, size_t size);
+    void Update(std::string_view s) { Update(s.data(), s.size()); }
+    void Update(const Hash128 &h) { Update(&h, sizeof(h)); }
+
+    Hash128 Final() const;
+
+private:
+    void Mix(uint64_t word);
+
+    uint64_t a = 0x9e3779b97f4a7c15, b = 0xc2b2ae3d27d4eb4f;
+};
+
+// Hash the contents of the file at <path>. Returns false if it cannot be
+// read.
+bool HashFile(const std::string &path, Hasher &hasher);
@@ -0,0 +1,234 @@
+#include "Coordinator.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+    Gauge &queued = NewGauge("cohort_queued_nights", "Nights waiting for a worker");
+    Counter &nights_done = NewCounter("cohort_nights_total", "Nights finished by workers");
+
+    struct Worker {
+        pid_t pid = -1;
+        int to = -1;  // worker's stdin
+        int from = -1;  // worker's stdout
+        std::string pending;  // partial line read from the worker
+        long night = -1;  // night being run, -1 if idle
+    };
+
+    bool Spawn(Worker &w, const std::vector<std::string> &args) {
+        int in[2], out[2];
+        if (pipe2(in, O_CLOEXEC) < 0) {
+            return false;
+        }
+        if (pipe2(out, O_CLOEXEC) < 0) {
+            close(in[0]);
+            close(in[1]);
+            return false;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            dup2(in[0], STDIN_FILENO);
+            dup2(out[1], STDOUT_FILENO);
+            std::vector<char *> argv;
+            for (const std::string &arg : args) {
+                argv.push_back(const_cast<char *>(arg.c_str()));
+            }
+            argv.push_back(nullptr);
+            execv("/proc/self/exe", argv.data());
+            _exit(127);
+        }
+        close(in[0]);
+        close(out[1]);
+        if (pid < 0) {
+            close(in[1]);
+            close(out[0]);
+            return false;
+        }
+        w = Worker();
+        w.pid = pid;
+        w.to = in[1];
+        w.from = out[0];
+        return true;
+    }
+
+    void Reap(Worker &w) {
+        close(w.to);
+        close(w.from);
+        waitpid(w.pid, nullptr, 0);
+        w.pid = -1;
+    }
+
+    bool WriteLine(int fd, const std::string &line) {
+        return write(fd, line.data(), line.size()) == ssize_t(line.size());
+    }
+}
+
+bool Coordinate(const std::vector<Night> &nights, const CohortRunner &runner, unsigned workers,
+                const std::vector<std::string> &args, int max_attempts, std::vector<NightResult> &results, CoordinatorStats &stats) {
+    // a worker that died is noticed on its pipe, not by a signal
+    signal(SIGPIPE, SIG_IGN);
+
+    results.assign(nights.size(), NightResult());
+    std::vector<int> attempts(nights.size(), 0);
+    std::vector<std::deque<size_t>> queues(workers);
+    for (size_t i = 0; i < nights.size(); i++) {
+        queues[i % workers].push_back(i);
+    }
+
+    std::vector<Worker> pool(workers);
+    for (Worker &w : pool) {
+        if (!Spawn(w, args)) {
+            std::cerr << "Unable to start worker: " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+
+    // a failed night goes back to the front of its worker's queue, or is
+    // given up on after <max_attempts>
+    size_t done = 0;
+    auto finish = [&](size_t slot, size_t night, const NightResult &r) {
+        if (!r.ok && ++attempts[night] < max_attempts) {
+            stats.retries++;
+            queues[slot].push_front(night);
+            return;
+        }
+        results[night] = r;
+        done++;
+        nights_done.Add();
+    };
+
+    auto dispatch = [&](size_t slot) {
+        Worker &w = pool[slot];
+        if (w.pid < 0 || w.night >= 0) {
+            return;
+        }
+        std::deque<size_t> *queue = &queues[slot];
+        bool steal = queue->empty();
+        if (steal) {
+            queue = &*std::max_element(queues.begin(), queues.end(), [](const auto &a, const auto &b) {
+                return a.size() < b.size();
+            });
+            if (queue->empty()) {
+                return;
+            }
+        }
+        size_t night = steal ? queue->back() : queue->front();
+        steal ? queue->pop_back() : queue->pop_front();
+        stats.steals += steal;
+        w.night = night;
+        WriteLine(w.to, std::to_string(night) + "\n");
+    };
+
+    while (done < nights.size()) {
+        for (size_t slot = 0; slot < pool.size(); slot++) {
+            dispatch(slot);
+        }
+        size_t waiting = 0;
+        for (const auto &queue : queues) {
+            waiting += queue.size();
+        }
+        queued.Set(waiting);
+
+        std::vector<pollfd> fds;
+        std::vector<size_t> slots;
+        for (size_t slot = 0; slot < pool.size(); slot++) {
+            if (pool[slot].pid >= 0) {
+                fds.push_back({pool[slot].from, POLLIN, 0});
+                slots.push_back(slot);
+            }
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Unable to poll workers: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        for (size_t k = 0; k < fds.size(); k++) {
+            if (!fds[k].revents) {
+                continue;
+            }
+            size_t slot = slots[k];
+            Worker &w = pool[slot];
+            char buf[4096];
+            ssize_t n = read(w.from, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (n <= 0) {
+                // the worker died, retry its night and start a new one
+                long night = w.night;
+                pid_t pid = w.pid;
+                Reap(w);
+                std::cerr << "coordinator: worker " << slot << " died";
+                if (night >= 0) {
+                    std::cerr << " running '" << nights[night].name << "'";
+                    runner.RemoveTemporaries(nights[night], pid);
+                    finish(slot, night, NightResult());
+                }
+                std::cerr << std::endl;
+                if (done < nights.size()) {
+                    if (stats.restarts >= nights.size() * max_attempts) {
+                        std::cerr << "coordinator: workers keep dying, giving up" << std::endl;
+                        for (Worker &other : pool) {
+                            if (other.pid >= 0) {
+                                Reap(other);
+                            }
+                        }
+                        return false;
+                    }
+                    if (!Spawn(w, args)) {
+                        std::cerr << "Unable to start worker: " << strerror(errno) << std::endl;
+                        return false;
+                    }
+                    stats.restarts++;
+                }
+                continue;
+            }
+
+            w.pending.append(buf, n);
+            for (size_t nl; (nl = w.pending.find('\n')) != std::string::npos;) {
+                std::istringstream line(w.pending.substr(0, nl));
+                w.pending.erase(0, nl + 1);
+                size_t night;
+                NightResult r;
+                if (line >> night >> r.ok >> r.hit >> r.seconds >> r.key && long(night) == w.night) {
+                    w.night = -1;
+                    finish(slot, night, r);
+                }
+            }
+        }
+    }
+
+    for (Worker &w : pool) {
+        if (w.pid >= 0) {
+            Reap(w);
+        }
+    }
+    return true;
+}
+
+int ServeWorker(const std::vector<Night> &nights, const CohortRunner &runner) {
+    for (size_t night; std::cin >> night;) {
+        NightResult r;
+        if (night < nights.size()) {
+            r = runner.Run(nights[night]);
+        }
+        std::cout << night << " " << r.ok << " " << r.hit << " " << r.seconds << " " << r.key << std::endl;
+    }
+    return 0;
+}
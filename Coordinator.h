@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Cohort.h"
+
+#include <string>
+#include <vector>
+
+/*
+ * Runs the nights of a cohort on worker processes, which are this binary
+ * started again with the same options plus --worker, as a stand-in for
+ * separate nodes. Each worker gets a queue of nights up front; one that runs
+ * out of work steals from the back of the longest remaining queue. Nights
+ * are handed out one at a time over the worker's stdin, and each result is
+ * reported back as a line on its stdout:
+ *
+ *   coordinator -> worker   INDEX
+ *   worker -> coordinator   INDEX OK HIT SECONDS KEY
+ *
+ * A night that fails, or whose worker dies while running it, is queued again
+ * and retried up to <max_attempts> times; dead workers are restarted, and
+ * the temporary files they left for their night are removed via <runner>.
+ */
+
+struct CoordinatorStats {
+    size_t steals = 0;  // nights run by a worker other than the one assigned
+    size_t retries = 0;
+    size_t restarts = 0;  // workers started again after dying
+};
+
+// Run <nights> on <workers> processes started with <args> (argv[1...] of a
+// worker), filling in <results> per night. Returns false if workers could
+// not be started or kept dying without finishing nights.
+bool Coordinate(const std::vector<Night> &nights, const CohortRunner &runner, unsigned workers,
+                const std::vector<std::string> &args, int max_attempts, std::vector<NightResult> &results, CoordinatorStats &stats);
+
+// Worker side: run the nights named on stdin until it is closed. Returns the
+// exit status.
+int ServeWorker(const std::vector<Night> &nights, const CohortRunner &runner);
@@ -0,0 +1,91 @@
+#include "CostModel.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool CostModel::Load(const std::string &path) {
+    std::ifstream infile(path);
+    if (!infile.is_open()) {
+        std::cerr << "Unable to open cost table '" << path << "'" << std::endl;
+        return false;
+    }
+
+    CostModel loaded = *this;
+    std::string line;
+    int lineno = 0;
+    while (std::getline(infile, line)) {
+        lineno++;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        std::string name;
+        double value;
+        if (!(fields >> name)) {
+            continue;
+        }
+        if (!(fields >> value)) {
+            std::cerr << path << ":" << lineno << ": missing value for '" << name << "'" << std::endl;
+            return false;
+        }
+
+        if (name == "add") loaded.add = value;
+        else if (name == "mul") loaded.mul = value;
+        else if (name == "div") loaded.div = value;
+        else if (name == "cmp") loaded.cmp = value;
+        else if (name == "sqrt") loaded.sqrt = value;
+        else if (name == "atan") loaded.atan = value;
+        else if (name == "clock_hz") loaded.clock_hz = value;
+        else if (name == "active_ua") loaded.active_ua = value;
+        else {
+            std::cerr << path << ":" << lineno << ": unknown cost '" << name << "'" << std::endl;
+            return false;
+        }
+    }
+
+    *this = loaded;
+    return true;
+}
+
+double CostModel::Cycles(const OpCounts &counts) const {
+    return counts.add * add + counts.mul * mul + counts.div * div + counts.cmp * cmp
+        + counts.sqrt * sqrt + counts.atan * atan;
+}
+
+double CostModel::MicroAmps(double cycles, double period_s) const {
+    return cycles / (clock_hz * period_s) * active_ua;
+}
+
+static void PrintCounts(std::ostream &out, const char *label, const OpCounts &counts, double n) {
+    if (n == 0) {
+        return;
+    }
+    out << label
+        << " add " << counts.add / n
+        << " mul " << counts.mul / n
+        << " div " << counts.div / n
+        << " cmp " << counts.cmp / n
+        << " sqrt " << counts.sqrt / n
+        << " atan " << counts.atan / n << std::endl;
+}
+
+void CostModel::Report(std::ostream &out, const OpCounts &sample_counts, uint64_t samples,
+                       const OpCounts &window_counts, uint64_t windows, double fs) const {
+    uint64_t total_samples = samples + windows;
+    if (total_samples == 0) {
+        out << "cost: no samples" << std::endl;
+        return;
+    }
+
+    PrintCounts(out, "cost: ops/sample", sample_counts, samples);
+    PrintCounts(out, "cost: ops/window", window_counts, windows);
+
+    double cycles_per_sample = samples ? Cycles(sample_counts) / samples : 0;
+    double cycles_per_window = windows ? Cycles(window_counts) / windows : 0;
+    double cycles_avg = (Cycles(sample_counts) + Cycles(window_counts)) / total_samples;
+    out << "cost: cycles/sample " << cycles_per_sample
+        << ", cycles/window " << cycles_per_window
+        << ", average " << cycles_avg << std::endl;
+    out << "cost: cpu load " << cycles_avg * fs / clock_hz * 100 << " %"
+        << ", avg current " << MicroAmps(cycles_avg, 1 / fs) << " uA" << std::endl;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "OpCount.h"
+
+#include <iosfwd>
+#include <string>
+
+/*
+ * Converts operation counts into estimated cycles and average current on the
+ * PineTime's nRF52832 (Cortex-M4F). The defaults are rough figures for
+ * single-precision FPU instructions and newlib's atanf; override them with a
+ * table file holding one "NAME VALUE" pair per line, e.g.
+ *
+ *   # cycles per operation
+ *   add 1
+ *   div 14
+ *   atan 120
+ *   # core clock and run current
+ *   clock_hz 64000000
+ *   active_ua 3700
+ */
+struct CostModel {
+    double add = 1;
+    double mul = 1;
+    double div = 14;
+    double cmp = 2;
+    double sqrt = 14;
+    double atan = 120;
+
+    double clock_hz = 64e6;
+    double active_ua = 3700;  // run current at clock_hz
+
+    // Returns false and leaves the model untouched on parse errors.
+    bool Load(const std::string &path);
+
+    double Cycles(const OpCounts &counts) const;
+
+    // Average current in µA when <cycles> are spent every <period_s> seconds.
+    double MicroAmps(double cycles, double period_s) const;
+
+    // Print cost of a replay. <sample_counts> covers the <samples> ordinary
+    // samples, <window_counts> the <windows> samples that closed a window.
+    void Report(std::ostream &out, const OpCounts &sample_counts, uint64_t samples,
+                const OpCounts &window_counts, uint64_t windows, double fs) const;
+};
@@ -0,0 +1,159 @@
+#include "CwaReader.h"
+#include "CivilTime.h"
+#include "MappedFile.h"
+#include "MemoryProfile.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    Gauge &decode_queue = NewGauge("decode_queue_depth", "Chunks being decoded ahead of the consumer");
+    constexpr size_t block_size = 512;
+    constexpr size_t chunk_blocks = 1024;  // blocks decoded per task
+
+    uint16_t U16(const uint8_t *p) {
+        return p[0] | p[1] << 8;
+    }
+
+    uint32_t U32(const uint8_t *p) {
+        return U16(p) | uint32_t(U16(p + 2)) << 16;
+    }
+
+    // Packed timestamp, MSB first: YYYYYYMM MMDDDDDh hhhhmmmm mmssssss
+    void DecodeTime(uint32_t t, int64_t &day, int &seconds) {
+        day = DaysFromCivil(2000 + ((t >> 26) & 0x3f), (t >> 22) & 0x0f, (t >> 17) & 0x1f);
+        seconds = ((t >> 12) & 0x1f) * 3600 + ((t >> 6) & 0x3f) * 60 + (t & 0x3f);
+    }
+
+    bool ValidBlock(const uint8_t *b) {
+        if (b[0] != 'A' || b[1] != 'X' || U16(b + 2) != block_size - 4) {
+            return false;
+        }
+        uint16_t sum = 0;
+        for (size_t i = 0; i < block_size; i += 2) {
+            sum += U16(b + i);
+        }
+        return sum == 0;
+    }
+
+    // Append the samples of one data block to <out>, with timestamps relative
+    // to midnight of <day0>.
+    void DecodeBlock(const uint8_t *b, int64_t day0, std::vector<Sample> &out) {
+        uint16_t fractional = U16(b + 4);
+        uint32_t timestamp = U32(b + 14);
+        uint16_t light_scale = U16(b + 18);
+        uint8_t rate_code = b[24];
+        int axes = b[25] >> 4;
+        int packing = b[25] & 0x0f;
+        int timestamp_offset = int16_t(U16(b + 26));
+        size_t count = U16(b + 28);
+        const uint8_t *data = b + 30;
+
+        double fs = 3200.0 / (1 << (15 - (rate_code & 0x0f)));
+
+        int64_t day;
+        int seconds;
+        DecodeTime(timestamp, day, seconds);
+        double t = double((day - day0) * 86400 + seconds);
+
+        // With the top bit set, the device stores a fraction of a second and
+        // has already shifted timestamp_offset to compensate for it.
+        double offset = timestamp_offset;
+        if (fractional & 0x8000) {
+            double fraction = ((fractional & 0x7fff) << 1) / 65536.0;
+            t += fraction;
+            offset += fraction * fs;
+        }
+        double start = t - offset / fs;
+
+        if (packing == 0) {
+            // 3 axes of 10 bits with a shared 2-bit exponent, 1/256 g units
+            count = std::min<size_t>(count, 480 / 4);
+            for (size_t i = 0; i < count; i++) {
+                uint32_t v = U32(data + 4 * i);
+                int shift = 6 - int(v >> 30);
+                int x = int16_t(uint16_t(0xffc0 & (v << 6))) >> shift;
+                int y = int16_t(uint16_t(0xffc0 & (v >> 4))) >> shift;
+                int z = int16_t(uint16_t(0xffc0 & (v >> 14))) >> shift;
+                out.push_back({start + i / fs, x / 256.0f, y / 256.0f, z / 256.0f, 0});
+            }
+        } else if (packing == 2 && (axes == 3 || axes == 6 || axes == 9)) {
+            // 16-bit signed values, gyroscope first on the AX6
+            float scale = 1.0f / (1 << (8 + ((light_scale >> 13) & 0x07)));
+            size_t stride = 2 * axes;
+            size_t accel = axes == 3 ? 0 : 6;
+            count = std::min<size_t>(count, 480 / stride);
+            for (size_t i = 0; i < count; i++) {
+                const uint8_t *s = data + stride * i + accel;
+                out.push_back({start + i / fs,
+                               int16_t(U16(s)) * scale,
+                               int16_t(U16(s + 2)) * scale,
+                               int16_t(U16(s + 4)) * scale,
+                               0});
+            }
+        }
+    }
+
+    std::vector<Sample> DecodeChunk(const uint8_t *blocks, size_t n, int64_t day0) {
+        MemoryStageScope stage(DecodeStage);
+        TraceSpan span("decode cwa");
+        std::vector<Sample> out;
+        out.reserve(n * 120);
+        for (size_t i = 0; i < n; i++) {
+            const uint8_t *b = blocks + i * block_size;
+            if (ValidBlock(b)) {
+                DecodeBlock(b, day0, out);
+            }
+        }
+        return out;
+    }
+}
+
+SampleBatches CwaSamples(int fd, unsigned threads) {
+    MappedFile map(fd);
+    const uint8_t *file = map.Data();
+    if (map.Size() < 4 || file[0] != 'M' || file[1] != 'D') {
+        throw std::runtime_error("not a CWA file");
+    }
+    size_t data_start = U16(file + 2) + 4;
+    size_t blocks = data_start < map.Size() ? (map.Size() - data_start) / block_size : 0;
+    const uint8_t *data = file + data_start;
+
+    // the day of the first valid block is the time origin
+    int64_t day0 = 0;
+    for (size_t i = 0; i < blocks; i++) {
+        if (ValidBlock(data + i * block_size)) {
+            int seconds;
+            DecodeTime(U32(data + i * block_size + 14), day0, seconds);
+            break;
+        }
+    }
+
+    // keep up to two chunks per thread in flight while the consumer works
+    std::deque<std::future<std::vector<Sample>>> pending;
+    size_t next = 0;
+    auto launch = [&] {
+        size_t n = std::min(chunk_blocks, blocks - next);
+        pending.push_back(std::async(std::launch::async, DecodeChunk, data + next * block_size, n, day0));
+        next += n;
+    };
+
+    while (next < blocks || !pending.empty()) {
+        while (next < blocks && pending.size() < 2 * std::max(threads, 1u)) {
+            launch();
+        }
+        decode_queue.Set(pending.size());
+        TraceSpan waiting("wait decode");
+        std::vector<Sample> chunk = pending.front().get();
+        waiting.End();
+        pending.pop_front();
+        if (!chunk.empty()) {
+            co_yield std::span<const Sample>(chunk);
+        }
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "SampleSource.h"
+
+/*
+ * Reader for Axivity AX3/AX6 .cwa files: a 1024-byte header followed by
+ * 512-byte data blocks, each holding up to 120 packed 10-bit or 80 16-bit
+ * triaxial samples, a block timestamp and the sample rate.
+ *
+ * The file is memory-mapped and decoded in place; chunks of blocks are
+ * unpacked on <threads> worker threads ahead of the consumer, and yielded in
+ * file order. Blocks with a bad checksum are skipped.
+ *
+ * Timestamps are in seconds since midnight (device clock) of the day of the
+ * first block, so they line up with clock time. Samples are at the device
+ * rate, typically 100 Hz; use Resample() to feed them to the tracker. Closes
+ * <fd> when done.
+ */
+SampleBatches CwaSamples(int fd, unsigned threads);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <utility>
+
+#include <unistd.h>
+
+// Closes a descriptor when it goes out of scope, also when a generator
+// reading from it is destroyed before it is done: pass it to the coroutine
+// by value, so it is moved into the frame before the first suspend.
+struct FileDescriptor {
+    int fd;
+
+    explicit FileDescriptor(int fd) : fd(fd) {}
+    FileDescriptor(FileDescriptor &&other) noexcept : fd(std::exchange(other.fd, -1)) {}
+    FileDescriptor(const FileDescriptor &) = delete;
+    FileDescriptor &operator=(const FileDescriptor &) = delete;
+
+    ~FileDescriptor() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+};
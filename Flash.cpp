@@ -0,0 +1,109 @@
+#include "Flash.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FlashEmulator::FlashEmulator(const std::string &path, FlashGeometry geometry)
+    : fd(open(path.c_str(), O_RDWR | O_CREAT, 0644)), geometry(geometry) {
+    if (fd < 0) {
+        throw std::runtime_error("unable to open '" + path + "': " + strerror(errno));
+    }
+    if (uint64_t(geometry.sector_size) * geometry.sectors > UINT32_MAX) {
+        close(fd);
+        throw std::runtime_error("flash larger than 4 GB");
+    }
+    stats.sector_erases.resize(geometry.sectors);
+
+    // new or short files are extended with erased sectors
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw std::runtime_error(std::string("unable to stat file: ") + strerror(errno));
+    }
+    std::vector<uint8_t> erased(geometry.sector_size, 0xff);
+    for (uint32_t s = st.st_size / geometry.sector_size; s < geometry.sectors; s++) {
+        WriteAt(s * geometry.sector_size, erased.data(), erased.size());
+    }
+}
+
+FlashEmulator::~FlashEmulator() {
+    close(fd);
+}
+
+void FlashEmulator::Read(uint32_t address, void *data, size_t size) {
+    if (address + size > geometry.Size() || pread(fd, data, size, address) != ssize_t(size)) {
+        throw std::runtime_error("flash read out of range");
+    }
+    stats.reads++;
+    stats.read_bytes += size;
+}
+
+void FlashEmulator::Program(uint32_t address, const void *data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    if (address + size > geometry.Size() || address / geometry.page_size != (address + size - 1) / geometry.page_size) {
+        throw std::runtime_error("flash program crosses a page");
+    }
+
+    uint8_t old[256];
+    std::vector<uint8_t> large;
+    uint8_t *current = old;
+    if (size > sizeof(old)) {
+        large.resize(size);
+        current = large.data();
+    }
+    if (pread(fd, current, size, address) != ssize_t(size)) {
+        throw std::runtime_error("flash read out of range");
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        if ((current[i] & bytes[i]) != bytes[i]) {
+            throw std::runtime_error("flash program over unerased bits at " + std::to_string(address + i));
+        }
+    }
+
+    stats.programs++;
+    stats.program_bytes += size;
+    if (Cut()) {
+        WriteAt(address, data, size / 2);
+        throw PowerLoss();
+    }
+    WriteAt(address, data, size);
+}
+
+void FlashEmulator::Erase(uint32_t sector) {
+    if (sector >= geometry.sectors) {
+        throw std::runtime_error("flash erase out of range");
+    }
+    stats.erases++;
+    stats.sector_erases[sector]++;
+    std::vector<uint8_t> erased(geometry.sector_size, 0xff);
+    if (Cut()) {
+        WriteAt(sector * geometry.sector_size, erased.data(), erased.size() / 2);
+        throw PowerLoss();
+    }
+    WriteAt(sector * geometry.sector_size, erased.data(), erased.size());
+}
+
+bool FlashEmulator::Cut() {
+    if (cut_after == UINT64_MAX) {
+        return false;
+    }
+    if (cut_after == 0) {
+        cut_after = UINT64_MAX;
+        return true;
+    }
+    cut_after--;
+    return false;
+}
+
+void FlashEmulator::WriteAt(uint32_t address, const void *data, size_t size) {
+    if (pwrite(fd, data, size, address) != ssize_t(size)) {
+        throw std::runtime_error(std::string("unable to write flash file: ") + strerror(errno));
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+ * NOR flash as seen by the history store: reads anywhere, programs that can
+ * only clear bits and are limited to one page per operation, and erases of
+ * whole sectors back to 0xff. The defaults match the 4 KB sectors and 256
+ * byte pages of the PineTime's SPI flash.
+ */
+struct FlashGeometry {
+    uint32_t sector_size = 4096;
+    uint32_t page_size = 256;
+    uint32_t sectors = 64;
+
+    uint32_t Size() const { return sector_size * sectors; }
+};
+
+class Flash {
+public:
+    virtual ~Flash() = default;
+
+    virtual const FlashGeometry &Geometry() const = 0;
+    virtual void Read(uint32_t address, void *data, size_t size) = 0;
+    // Must not cross a page boundary.
+    virtual void Program(uint32_t address, const void *data, size_t size) = 0;
+    virtual void Erase(uint32_t sector) = 0;
+};
+
+struct FlashStats {
+    uint64_t reads = 0;
+    uint64_t read_bytes = 0;
+    uint64_t programs = 0;
+    uint64_t program_bytes = 0;
+    uint64_t erases = 0;
+    std::vector<uint64_t> sector_erases;
+};
+
+// Thrown by the emulator when its simulated power cut happens.
+struct PowerLoss : std::runtime_error {
+    PowerLoss() : std::runtime_error("power loss") {}
+};
+
+/*
+ * Flash emulated in a regular file, which is created erased if it does not
+ * exist, so the contents survive between runs like on the device. Counts
+ * every operation. A program over bits that are not erased throws
+ * std::runtime_error, as it would silently corrupt data on real flash.
+ *
+ * With CutPowerAfter(n), the operation after the next <n> is torn: a program
+ * writes only the first half of its bytes, an erase only clears the first
+ * half of the sector, and PowerLoss is thrown.
+ */
+class FlashEmulator : public Flash {
+public:
+    // Throws std::runtime_error if the file cannot be opened.
+    FlashEmulator(const std::string &path, FlashGeometry geometry);
+    ~FlashEmulator() override;
+
+    FlashEmulator(const FlashEmulator &) = delete;
+    FlashEmulator &operator=(const FlashEmulator &) = delete;
+
+    const FlashGeometry &Geometry() const override { return geometry; }
+    void Read(uint32_t address, void *data, size_t size) override;
+    void Program(uint32_t address, const void *data, size_t size) override;
+    void Erase(uint32_t sector) override;
+
+    void CutPowerAfter(uint64_t operations) { cut_after = operations; }
+    const FlashStats &Stats() const { return stats; }
+
+private:
+    bool Cut();
+    void WriteAt(uint32_t address, const void *data, size_t size);
+
+    int fd;
+    FlashGeometry geometry;
+    FlashStats stats;
+    uint64_t cut_after = UINT64_MAX;
+};
@@ -0,0 +1,262 @@
+#include "Follow.h"
+#include "FileDescriptor.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    constexpr char magic[8] = {'F', 'O', 'L', 'L', 'O', 'W', 'S', 'T'};
+    constexpr uint32_t version = 1;
+    constexpr size_t read_size = 1 << 16;
+
+    Counter &rows_read = NewCounter("follow_rows_total", "Rows read from the followed file");
+    Counter &transitions = NewCounter("follow_transitions_total", "State changes reported in follow mode");
+    Gauge &lag = NewGauge("follow_lag_bytes", "Bytes appended to the followed file and not yet read");
+    Histogram &update_latency = NewHistogram("follow_update_seconds", "Time taken by one model update");
+
+    bool WriteAll(int fd, const void *data, size_t size) {
+        const char *p = static_cast<const char *>(data);
+        while (size > 0) {
+            ssize_t n = write(fd, p, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            p += n;
+            size -= n;
+        }
+        return true;
+    }
+}
+
+static_assert(std::is_trivially_copyable_v<VanHeesModel<float>>, "the model is saved as raw bytes");
+
+Follower::Follower(const std::string &path, const std::string &state_path, const TextSchema &schema,
+                   const VanHeesModel<float>::Config &config, Emit emit)
+    : path(path), state_path(state_path), schema(schema), config(config), parser(schema), emit(std::move(emit)),
+      fd(open(path.c_str(), O_RDONLY | O_CLOEXEC)) {
+    if (fd < 0) {
+        throw std::runtime_error("unable to open '" + path + "': " + strerror(errno));
+    }
+    Reset();
+    if (!Load()) {
+        close(fd);
+        throw std::runtime_error("unable to read state file '" + state_path + "'");
+    }
+
+    struct stat st;
+    fstat(fd, &st);
+    if (state.offset > 0 && (state.device != uint64_t(st.st_dev) || state.inode != uint64_t(st.st_ino))) {
+        std::cerr << "'" << path << "' was replaced, starting over" << std::endl;
+        Reset();
+    } else if (state.offset > 0 && state.model.Configuration() != config) {
+        std::cerr << "model settings differ from those in '" << state_path << "', starting over with the new ones"
+                  << std::endl;
+        Reset();
+    }
+    state.device = st.st_dev;
+    state.inode = st.st_ino;
+    ResolveHeader();
+}
+
+Follower::~Follower() {
+    close(fd);
+}
+
+void Follower::Reset() {
+    memcpy(state.magic, magic, sizeof(magic));
+    state.version = version;
+    state.size = sizeof(State);
+    state.offset = 0;
+    state.rows = 0;
+    state.last_state = -1;
+    state.model = VanHeesModel<float>(config);
+    parser = RowParser(schema);
+    len = 0;
+}
+
+bool Follower::Load() {
+    int in = open(state_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return errno == ENOENT;  // first run
+    }
+    FileDescriptor closer {in};
+
+    State saved;
+    if (read(in, &saved, sizeof(saved)) != sizeof(saved) || memcmp(saved.magic, magic, sizeof(magic)) != 0
+        || saved.version != version || saved.size != sizeof(State)) {
+        return false;
+    }
+    state = saved;
+    return true;
+}
+
+bool Follower::Save() {
+    std::string tmp = state_path + ".tmp";
+    int out = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = out >= 0;
+    if (ok) {
+        ok = WriteAll(out, &state, sizeof(state)) && fsync(out) == 0;
+        ok = close(out) == 0 && ok;
+    }
+    ok = ok && rename(tmp.c_str(), state_path.c_str()) == 0;
+    if (!ok) {
+        std::cerr << "Unable to write '" << state_path << "': " << strerror(errno) << std::endl;
+    }
+    return ok;
+}
+
+// With a header row, column names have to be resolved again after a restart.
+void Follower::ResolveHeader() {
+    if (!schema.header || state.rows <= uint64_t(schema.skip)) {
+        return;
+    }
+    std::vector<char> head;
+    size_t pos = 0, line = 0;
+    int row = 0;
+    for (;;) {
+        head.resize(pos + read_size + 1);
+        ssize_t n = pread(fd, head.data() + pos, read_size, pos);
+        if (n <= 0) {
+            throw std::runtime_error("unable to read the header of '" + path + "'");
+        }
+        for (size_t end = pos + n; pos < end; pos++) {
+            if (head[pos] != '\n') {
+                continue;
+            }
+            if (row++ == schema.skip) {
+                head[pos] = '\0';
+                parser.Header(head.data() + line, head.data() + pos);
+                return;
+            }
+            line = pos + 1;
+        }
+    }
+}
+
+void Follower::Row(const char *p, const char *end) {
+    int preamble = schema.skip + (schema.header ? 1 : 0);
+    if (state.rows++ < uint64_t(preamble)) {
+        if (schema.header && state.rows == uint64_t(preamble)) {
+            parser.Header(p, end);
+        }
+        return;
+    }
+
+    Sample s;
+    if (!parser.Parse(p, end, s)) {
+        return;
+    }
+    auto start = metrics_enabled ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    bool classified = state.model.Update(s.x, s.y, s.z);
+    if (metrics_enabled) {
+        update_latency.Observe(std::chrono::steady_clock::now() - start);
+    }
+    rows_read.Add();
+    if (classified && state.model.State() != state.last_state) {
+        transitions.Add();
+        state.last_state = state.model.State();
+        emit(s.t, state.model.State());
+    }
+}
+
+bool Follower::Poll() {
+    TraceSpan span("poll");
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        std::cerr << "Unable to stat '" << path << "': " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (uint64_t(st.st_size) < state.offset + len) {
+        std::cerr << "'" << path << "' was truncated, starting over" << std::endl;
+        Reset();
+    }
+    lag.Set(st.st_size - state.offset - len);
+
+    uint64_t start = state.offset;
+    for (;;) {
+        buf.resize(len + read_size + 1);
+        ssize_t n = pread(fd, buf.data() + len, read_size, state.offset + len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            std::cerr << "Unable to read '" << path << "': " << strerror(errno) << std::endl;
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        len += n;
+
+        // only complete rows are consumed, the partial one is read again
+        char *p = buf.data();
+        char *end = p + len;
+        while (char *nl = static_cast<char *>(memchr(p, '\n', end - p))) {
+            *nl = '\0';
+            Row(p, nl);
+            p = nl + 1;
+        }
+        state.offset += p - buf.data();
+        len = end - p;
+        memmove(buf.data(), p, len);
+    }
+    lag.Set(0);
+
+    return state.offset == start || Save();
+}
+
+int Follower::Run() {
+    int in = inotify_init1(IN_CLOEXEC);
+    if (in < 0) {
+        std::cerr << "Unable to initialize inotify: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    FileDescriptor closer {in};
+    if (inotify_add_watch(in, path.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+        std::cerr << "Unable to watch '" << path << "': " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    // catch up with rows written while not running
+    if (!Poll()) {
+        return 1;
+    }
+
+    alignas(inotify_event) char events[4096];
+    for (;;) {
+        ssize_t n = read(in, events, sizeof(events));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            std::cerr << "Unable to read inotify events: " << strerror(errno) << std::endl;
+            return 1;
+        }
+
+        bool gone = false;
+        for (char *p = events; p < events + n;) {
+            const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+            gone |= (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) != 0;
+            p += sizeof(inotify_event) + event->len;
+        }
+        if (!Poll()) {
+            return 1;
+        }
+        if (gone) {
+            return 0;
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "TextSchema.h"
+#include "VanHeesModel.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * Incremental processing of a text input that keeps growing: rows appended
+ * to the file are read from where the last pass stopped, fed to the model and
+ * state changes are reported as they happen. The model, the byte offset of
+ * the first unread row and the file's identity are saved to a state file
+ * after every pass, so a restarted process resumes at that offset instead of
+ * reprocessing the file. The cost of a pass is proportional to the new rows.
+ *
+ * The state file is replaced atomically. Transitions reported after the last
+ * save are reported again on restart. If the file is truncated or replaced by
+ * a different one, or the model settings given differ from the saved ones,
+ * processing starts over from its beginning.
+ *
+ * The tracker itself cannot be serialized, so the state kept is that of the
+ * host-side reference model (see VanHeesModel.h).
+ */
+class Follower {
+public:
+    // Called with the time and new state when the state changes.
+    using Emit = std::function<void(double t, uint8_t state)>;
+
+    // Opens <path> and restores the state from <state_path> if it exists.
+    // Throws std::runtime_error if either cannot be opened or read.
+    Follower(const std::string &path, const std::string &state_path, const TextSchema &schema,
+             const VanHeesModel<float>::Config &config, Emit emit);
+    ~Follower();
+
+    Follower(const Follower &) = delete;
+    Follower &operator=(const Follower &) = delete;
+
+    // Process the complete rows appended since the last pass and save the
+    // state. Returns false and prints an error on failure.
+    bool Poll();
+
+    // Poll whenever inotify reports the file was written to, until it is
+    // removed or renamed. Returns the exit status.
+    int Run();
+
+private:
+    struct State {
+        char magic[8];
+        uint32_t version;
+        uint32_t size;  // sizeof(State), as a check on the layout
+        uint64_t device, inode;  // identity of the followed file
+        uint64_t offset;  // bytes consumed, always at the start of a row
+        uint64_t rows;  // rows consumed, including the preamble
+        int32_t last_state;  // last reported state, -1 for none
+        VanHeesModel<float> model;
+    };
+
+    void Reset();
+    bool Load();
+    bool Save();
+    void Row(const char *p, const char *end);
+    void ResolveHeader();
+
+    std::string path, state_path;
+    TextSchema schema;
+    VanHeesModel<float>::Config config;
+    RowParser parser;
+    Emit emit;
+    int fd;
+    State state;
+    std::vector<char> buf;
+    size_t len = 0;  // partial row at the end of buf
+};
@@ -0,0 +1,198 @@
+#include "GeneActivReader.h"
+#include "CivilTime.h"
+#include "MappedFile.h"
+#include "MemoryProfile.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace {
+    Gauge &decode_queue = NewGauge("decode_queue_depth", "Chunks being decoded ahead of the consumer");
+    constexpr size_t chunk_pages = 256;  // pages decoded per task
+    constexpr std::string_view page_marker = "Recorded Data";
+
+    struct Calibration {
+        double gain[3] = {1, 1, 1};
+        double offset[3] = {};
+    };
+
+    // Value of the first "<key>:<value>" line in [p, end), or an empty view.
+    std::string_view Find(const char *p, const char *end, std::string_view key) {
+        std::string_view text(p, end - p);
+        size_t pos = 0;
+        while ((pos = text.find(key, pos)) != std::string_view::npos) {
+            if ((pos == 0 || text[pos - 1] == '\n') && pos + key.size() < text.size()
+                && text[pos + key.size()] == ':') {
+                size_t begin = pos + key.size() + 1;
+                size_t eol = text.find_first_of("\r\n", begin);
+                return text.substr(begin, (eol == std::string_view::npos ? text.size() : eol) - begin);
+            }
+            pos += key.size();
+        }
+        return {};
+    }
+
+    double Number(std::string_view v) {
+        return strtod(std::string(v).c_str(), nullptr);
+    }
+
+    // "YYYY-MM-DD hh:mm:ss:mmm" as day number and seconds of the day.
+    bool ParseTime(std::string_view v, int64_t &day, double &seconds) {
+        int y, mo, d, h, mi, s, ms = 0;
+        if (sscanf(std::string(v).c_str(), "%d-%d-%d %d:%d:%d:%d", &y, &mo, &d, &h, &mi, &s, &ms) < 6) {
+            return false;
+        }
+        day = DaysFromCivil(y, mo, d);
+        seconds = h * 3600 + mi * 60 + s + ms / 1000.0;
+        return true;
+    }
+
+    typedef uint8_t v16u8 __attribute__((vector_size(16)));
+
+    // Convert hex digits to their values, 16 at a time. Works for 0-9, A-F
+    // and a-f: the low nibble is the value for digits and value - 9 for
+    // letters, which have bit 6 set.
+    void HexToNibbles(const char *hex, size_t n, uint8_t *out) {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            v16u8 c;
+            memcpy(&c, hex + i, 16);
+            v16u8 v = (c & 0x0f) + (c >> 6) * 9;
+            memcpy(out + i, &v, 16);
+        }
+        for (; i < n; i++) {
+            uint8_t c = hex[i];
+            out[i] = (c & 0x0f) + (c >> 6) * 9;
+        }
+    }
+
+    int Signed12(const uint8_t *n) {
+        int v = n[0] << 8 | n[1] << 4 | n[2];
+        return v >= 2048 ? v - 4096 : v;
+    }
+
+    // Append the samples of the page starting at <p> to <out>.
+    void DecodePage(const char *p, const char *end, int64_t day0, const Calibration &cal,
+                    std::vector<Sample> &out, std::vector<uint8_t> &nibbles) {
+        int64_t day;
+        double t;
+        if (!ParseTime(Find(p, end, "Page Time"), day, t)) {
+            return;
+        }
+        t += (day - day0) * 86400.0;
+        double fs = Number(Find(p, end, "Measurement Frequency"));
+        if (fs <= 0) {
+            return;
+        }
+
+        // the sample data is the last line of the page
+        std::string_view freq = Find(p, end, "Measurement Frequency");
+        const char *data = freq.data() + freq.size();
+        while (data < end && (*data == '\r' || *data == '\n')) {
+            data++;
+        }
+        const char *data_end = data;
+        while (data_end < end && *data_end != '\r' && *data_end != '\n') {
+            data_end++;
+        }
+
+        size_t count = (data_end - data) / 12;
+        nibbles.resize(count * 12);
+        HexToNibbles(data, count * 12, nibbles.data());
+
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t *n = nibbles.data() + 12 * i;
+            float g[3];
+            for (int axis = 0; axis < 3; axis++) {
+                g[axis] = float((Signed12(n + 3 * axis) * 100 - cal.offset[axis]) / cal.gain[axis]);
+            }
+            out.push_back({t + i / fs, g[0], g[1], g[2], 0});
+        }
+    }
+
+    std::vector<Sample> DecodeChunk(const char *file, const std::vector<size_t> &pages, size_t first,
+                                    size_t n, size_t file_size, int64_t day0, const Calibration &cal) {
+        MemoryStageScope stage(DecodeStage);
+        TraceSpan span("decode geneactiv");
+        std::vector<Sample> out;
+        std::vector<uint8_t> nibbles;
+        out.reserve(n * 300);
+        for (size_t i = first; i < first + n; i++) {
+            size_t page_end = i + 1 < pages.size() ? pages[i + 1] : file_size;
+            DecodePage(file + pages[i], file + page_end, day0, cal, out, nibbles);
+        }
+        return out;
+    }
+}
+
+SampleBatches GeneActivSamples(int fd, unsigned threads) {
+    MappedFile map(fd);
+    const char *file = reinterpret_cast<const char *>(map.Data());
+    std::string_view text(file, map.Size());
+
+    // locate the pages; everything before the first one is the file header
+    std::vector<size_t> pages;
+    {
+        MemoryStageScope stage(DecodeStage);
+        for (size_t pos = text.find(page_marker); pos != std::string_view::npos;
+             pos = text.find(page_marker, pos + page_marker.size())) {
+            pages.push_back(pos);
+        }
+    }
+    if (pages.empty()) {
+        throw std::runtime_error("not a GENEActiv file, or no recorded data");
+    }
+
+    Calibration cal;
+    const char *header_end = file + pages[0];
+    const char *axes[3] = {"x", "y", "z"};
+    for (int axis = 0; axis < 3; axis++) {
+        std::string gain = std::string(axes[axis]) + " gain";
+        std::string offset = std::string(axes[axis]) + " offset";
+        std::string_view g = Find(file, header_end, gain);
+        if (g.empty() || Number(g) == 0) {
+            throw std::runtime_error("missing calibration data");
+        }
+        cal.gain[axis] = Number(g);
+        cal.offset[axis] = Number(Find(file, header_end, offset));
+    }
+
+    int64_t day0;
+    double seconds;
+    size_t first_page_end = pages.size() > 1 ? pages[1] : map.Size();
+    if (!ParseTime(Find(file + pages[0], file + first_page_end, "Page Time"), day0, seconds)) {
+        throw std::runtime_error("invalid page time");
+    }
+
+    // keep up to two chunks per thread in flight while the consumer works
+    std::deque<std::future<std::vector<Sample>>> pending;
+    size_t next = 0;
+    auto launch = [&] {
+        size_t n = std::min(chunk_pages, pages.size() - next);
+        pending.push_back(std::async(std::launch::async, DecodeChunk, file, std::cref(pages), next, n,
+                                     map.Size(), day0, std::cref(cal)));
+        next += n;
+    };
+
+    while (next < pages.size() || !pending.empty()) {
+        while (next < pages.size() && pending.size() < 2 * std::max(threads, 1u)) {
+            launch();
+        }
+        decode_queue.Set(pending.size());
+        TraceSpan waiting("wait decode");
+        std::vector<Sample> chunk = pending.front().get();
+        waiting.End();
+        pending.pop_front();
+        if (!chunk.empty()) {
+            co_yield std::span<const Sample>(chunk);
+        }
+    }
+}
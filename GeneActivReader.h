@@ -0,0 +1,16 @@
+#pragma once
+
+#include "SampleSource.h"
+
+/*
+ * Reader for GENEActiv .bin files: a text header with the calibration data,
+ * followed by pages of a few header lines and one line of 300 samples, each
+ * 12 hex digits holding 12-bit signed x, y and z, light and button state.
+ *
+ * The file is memory-mapped, pages are located with a quick scan and then
+ * decoded on <threads> worker threads with a vectorized hex decoder, and the
+ * calibration (raw * 100 - offset) / gain is applied. Timestamps are seconds
+ * since midnight of the first page's day. Samples are at the device rate;
+ * use Resample() to feed them to the tracker. Closes <fd> when done.
+ */
+SampleBatches GeneActivSamples(int fd, unsigned threads);
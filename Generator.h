@@ -0,0 +1,102 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <utility>
+
+/*
+ * Minimal lazy generator for C++20 coroutines (std::generator is C++23).
+ * Values are produced on demand as the generator is iterated, so generators
+ * can be chained without buffering their output in between.
+ *
+ * The yielded value is stored by value in the promise, so yielding a span or
+ * pointer is cheap but only valid until the generator is resumed again.
+ */
+template <typename T>
+class Generator {
+public:
+    struct promise_type {
+        T value;
+        std::exception_ptr exception;
+
+        Generator get_return_object() {
+            return Generator(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(T v) {
+            value = std::move(v);
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+
+        iterator() = default;
+        explicit iterator(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+        const T &operator*() const { return handle.promise().value; }
+        iterator &operator++() {
+            Resume(handle);
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+        bool operator==(std::default_sentinel_t) const { return !handle || handle.done(); }
+
+    private:
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    Generator() = default;
+    Generator(Generator &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Generator &operator=(Generator &&other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    ~Generator() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    iterator begin() {
+        Resume(handle);
+        return iterator(handle);
+    }
+    std::default_sentinel_t end() { return {}; }
+
+    // Advance to the next value, returning false when the generator is done.
+    // Alternative to range-for for consumers that interleave several generators.
+    bool Next() {
+        Resume(handle);
+        return !handle.done();
+    }
+    const T &Value() const { return handle.promise().value; }
+
+private:
+    explicit Generator(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    static void Resume(std::coroutine_handle<promise_type> handle) {
+        if (!handle || handle.done()) {
+            return;
+        }
+        handle.resume();
+        if (handle.promise().exception) {
+            std::rethrow_exception(std::exchange(handle.promise().exception, {}));
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle;
+};
@@ -0,0 +1,108 @@
+#include "Hdcza.h"
+
+#include <algorithm>
+#include <cmath>
+
+HdczaDetector::HdczaDetector(const HdczaConfig &config, Period period)
+    : config(config), period(std::move(period)), epoch_samples(int(config.fs * config.epoch)),
+      median(size_t(config.median_window / config.epoch)) {}
+
+void HdczaDetector::Update(double t, float x, float y, float z) {
+    if (in_epoch == 0) {
+        epoch_t = t;
+    }
+    sum[0] += x;
+    sum[1] += y;
+    sum[2] += z;
+    if (++in_epoch == epoch_samples) {
+        Epoch();
+    }
+}
+
+void HdczaDetector::Epoch() {
+    double x = sum[0] / in_epoch, y = sum[1] / in_epoch, z = sum[2] / in_epoch;
+    float angle = float(std::atan(z / std::sqrt(x * x + y * y)) * 180 / M_PI);
+    double t = epoch_t;
+    sum[0] = sum[1] = sum[2] = 0;
+    in_epoch = 0;
+
+    if (!have_angle) {
+        have_angle = true;
+        last_angle = angle;
+        return;
+    }
+    median.Add(std::fabs(angle - last_angle));
+    last_angle = angle;
+    if (!median.Full()) {
+        return;
+    }
+
+    // days run from noon to noon; the median is centred on its window
+    double centre = t - config.median_window / 2;
+    int64_t d = int64_t(std::floor((centre - config.day_start) / 86400));
+    if (d != day) {
+        EndDay();
+        day = d;
+        day_t = centre;
+    }
+    float m = median.Median();
+    medians.push_back(m);
+    day_sketch.Add(m);
+}
+
+float HdczaDetector::Threshold() const {
+    KllSketch all = recording_sketch;
+    all.Merge(day_sketch);
+    float threshold = config.scale * all.Quantile(config.percentile);
+    return std::clamp(threshold, config.min_threshold, config.max_threshold);
+}
+
+void HdczaDetector::EndDay() {
+    if (medians.empty()) {
+        return;
+    }
+    recording_sketch.Merge(day_sketch);
+    day_sketch = KllSketch();
+    float threshold = Threshold();
+
+    // runs below the threshold, longer than min_block, joined across short gaps
+    const size_t min_block = size_t(config.min_block / config.epoch);
+    const size_t max_gap = size_t(config.max_gap / config.epoch);
+    size_t best_start = 0, best_end = 0;
+    size_t start = 0, end = 0;  // current joined block
+    bool have_block = false;
+    for (size_t i = 0; i <= medians.size();) {
+        while (i < medians.size() && medians[i] >= threshold) {
+            i++;
+        }
+        size_t run = i;
+        while (i < medians.size() && medians[i] < threshold) {
+            i++;
+        }
+        if (i - run > min_block) {
+            if (have_block && run - end < max_gap) {
+                end = i;
+            } else {
+                start = run;
+                end = i;
+                have_block = true;
+            }
+            if (end - start > best_end - best_start) {
+                best_start = start;
+                best_end = end;
+            }
+        }
+        if (i == medians.size()) {
+            break;
+        }
+    }
+
+    if (best_end > best_start) {
+        period(day_t + best_start * config.epoch, day_t + best_end * config.epoch, threshold);
+    }
+    medians.clear();
+}
+
+void HdczaDetector::Finish() {
+    EndDay();
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "KllSketch.h"
+#include "RollingMedian.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/*
+ * Streaming sleep period time (SPT) detection after van Hees et al. 2018
+ * (HDCZA):
+ *
+ *   1. z-angle of the mean acceleration of each 5 s epoch
+ *   2. absolute change in z-angle between epochs
+ *   3. 5 minute rolling median of the change
+ *   4. threshold: 15 times the 10th percentile of the rolling median,
+ *      limited to [0.13, 0.50] degrees
+ *   5. runs below the threshold longer than 30 minutes, joined across gaps
+ *      shorter than 60 minutes; the longest is the SPT
+ *
+ * Days run from noon to noon, taking t = 0 as midnight: clock time for CWA
+ * and GENEActiv input, but for text input only if its times are seconds
+ * since a midnight. The percentile comes from a KLL sketch, one per
+ * day merged into one for the whole recording, and a day's SPT is found with
+ * the recording-wide threshold as known at the end of that day. Memory is
+ * bounded by one day of rolling medians, however long the recording.
+ */
+
+struct HdczaConfig {
+    int fs = 10;  // Hz
+    double epoch = 5;  // seconds
+    double median_window = 300;  // seconds
+    double percentile = 0.1;
+    float scale = 15;
+    float min_threshold = 0.13f, max_threshold = 0.5f;  // degrees
+    double min_block = 30 * 60;  // seconds
+    double max_gap = 60 * 60;  // seconds
+    double day_start = 12 * 3600;  // seconds after t = 0 where days split
+};
+
+class HdczaDetector {
+public:
+    // Called once per day that has an SPT, with its onset and wake times and
+    // the threshold used.
+    using Period = std::function<void(double onset, double wake, float threshold)>;
+
+    HdczaDetector(const HdczaConfig &config, Period period);
+
+    void Update(double t, float x, float y, float z);
+
+    // Close the last day.
+    void Finish();
+
+    float Threshold() const;
+
+private:
+    void Epoch();
+    void EndDay();
+
+    HdczaConfig config;
+    Period period;
+    int epoch_samples;
+
+    double sum[3] = {};
+    int in_epoch = 0;
+    double epoch_t = 0;
+
+    bool have_angle = false;
+    float last_angle = 0;
+    RollingMedian median;
+
+    // rolling medians of the current day, with the time of the first
+    int64_t day = INT64_MIN;
+    double day_t = 0;
+    std::vector<float> medians;
+
+    KllSketch day_sketch;
+    KllSketch recording_sketch;
+};
@@ -0,0 +1,205 @@
+#include "HistoryLog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    constexpr uint32_t magic = 0x31484c53;  // "SLH1"
+    constexpr uint32_t header_size = 16;
+    constexpr uint32_t record_overhead = 4;
+
+    uint16_t Crc16(const uint8_t *data, size_t size, uint16_t crc = 0xffff) {
+        for (size_t i = 0; i < size; i++) {
+            crc ^= uint16_t(data[i]) << 8;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+            }
+        }
+        return crc;
+    }
+
+    void PutU32(uint8_t *p, uint32_t v) {
+        memcpy(p, &v, 4);
+    }
+
+    uint32_t GetU32(const uint8_t *p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+}
+
+bool HistoryLog::Header::Valid() const {
+    return magic == ::magic && check == (magic ^ sequence ^ erase_count);
+}
+
+HistoryLog::HistoryLog(Flash &flash) : flash(flash), geometry(flash.Geometry()) {
+    // the newest sector is the head
+    bool found = false;
+    for (uint32_t s = 0; s < geometry.sectors; s++) {
+        Header header = ReadHeader(s);
+        if (header.Valid() && (!found || header.sequence > sequence)) {
+            found = true;
+            head = s;
+            sequence = header.sequence;
+        }
+    }
+    if (!found) {
+        return;  // the first append opens a sector
+    }
+
+    bool clean;
+    offset = Scan(head, clean, [&](uint8_t, const uint8_t *, size_t) {});
+    if (!clean) {
+        torn++;
+        offset = geometry.sector_size;  // closed, the next append opens a new sector
+    }
+}
+
+HistoryLog::Header HistoryLog::ReadHeader(uint32_t sector) {
+    uint8_t bytes[header_size];
+    flash.Read(sector * geometry.sector_size, bytes, header_size);
+    return {GetU32(bytes), GetU32(bytes + 4), GetU32(bytes + 8), GetU32(bytes + 12)};
+}
+
+uint32_t HistoryLog::Scan(uint32_t sector, bool &clean,
+                          const std::function<void(uint8_t type, const uint8_t *payload, size_t length)> &record) {
+    std::vector<uint8_t> data(geometry.sector_size);
+    flash.Read(sector * geometry.sector_size, data.data(), data.size());
+
+    uint32_t pos = header_size;
+    while (pos + record_overhead <= data.size() && data[pos] != 0xff) {
+        size_t length = data[pos];
+        if (pos + record_overhead + length > data.size()) {
+            break;
+        }
+        uint16_t crc;
+        memcpy(&crc, &data[pos + 2 + length], 2);
+        if (crc != Crc16(&data[pos], 2 + length)) {
+            break;
+        }
+        record(data[pos + 1], &data[pos + 2], length);
+        pos += record_overhead + length;
+    }
+    clean = std::all_of(data.begin() + pos, data.end(), [](uint8_t b) { return b == 0xff; });
+    return pos;
+}
+
+void HistoryLog::OpenSector(uint32_t sector) {
+    Header old = ReadHeader(sector);
+    if (old.Valid()) {
+        dropped++;
+    }
+    // a sector whose header was lost restarts its count
+    uint32_t erase_count = (old.Valid() ? old.erase_count : 0) + 1;
+    flash.Erase(sector);
+
+    uint8_t bytes[header_size];
+    uint32_t next = sequence + 1;
+    PutU32(bytes, magic);
+    PutU32(bytes + 4, next);
+    PutU32(bytes + 8, erase_count);
+    PutU32(bytes + 12, magic ^ next ^ erase_count);
+    flash.Program(sector * geometry.sector_size, bytes, header_size);
+
+    head = sector;
+    sequence = next;
+    offset = header_size;
+}
+
+void HistoryLog::Append(uint8_t type, const uint8_t *payload, size_t length) {
+    uint8_t record[255 + record_overhead];
+    record[0] = uint8_t(length);
+    record[1] = type;
+    memcpy(record + 2, payload, length);
+    uint16_t crc = Crc16(record, 2 + length);
+    memcpy(record + 2 + length, &crc, 2);
+    size_t size = length + record_overhead;
+
+    if (offset == 0 || offset + size > geometry.sector_size) {
+        OpenSector(offset == 0 && sequence == 0 ? 0 : (head + 1) % geometry.sectors);
+    }
+
+    // one program per page touched
+    uint32_t address = head * geometry.sector_size + offset;
+    for (size_t done = 0; done < size;) {
+        size_t n = std::min<size_t>(size - done, geometry.page_size - (address + done) % geometry.page_size);
+        flash.Program(address + done, record + done, n);
+        done += n;
+    }
+    offset += size;
+    payload_bytes += length;
+    records++;
+}
+
+void HistoryLog::AddTransition(double t, uint8_t state) {
+    Commit();
+    uint8_t payload[5];
+    PutU32(payload, uint32_t(std::lround(t)));
+    payload[4] = state;
+    Append(TransitionRecord, payload, sizeof(payload));
+}
+
+void HistoryLog::AddWindow(double t, float change) {
+    if (!windows.empty()) {
+        double expected = windows_t0 + (windows.size() - 5) * window_seconds;
+        if (std::abs(t - expected) > window_seconds / 2) {
+            Commit();
+        }
+    }
+    if (windows.empty()) {
+        windows_t0 = uint32_t(std::lround(t));
+        windows.resize(5);
+        PutU32(windows.data(), windows_t0);
+    }
+    windows.push_back(uint8_t(std::clamp(std::lround(change * 10), 0L, 255L)));
+    windows[4] = uint8_t(windows.size() - 5);
+    if (windows[4] == windows_per_record) {
+        Commit();
+    }
+}
+
+void HistoryLog::Commit() {
+    if (!windows.empty()) {
+        Append(WindowRecord, windows.data(), windows.size());
+        windows.clear();
+    }
+}
+
+void HistoryLog::Wear(uint32_t &least, uint32_t &most) {
+    least = UINT32_MAX;
+    most = 0;
+    for (uint32_t s = 0; s < geometry.sectors; s++) {
+        Header header = ReadHeader(s);
+        uint32_t erases = header.Valid() ? header.erase_count : 0;
+        least = std::min(least, erases);
+        most = std::max(most, erases);
+    }
+}
+
+void HistoryLog::Replay(const std::function<void(double t, uint8_t state)> &transition,
+                        const std::function<void(double t, float change)> &window) {
+    std::vector<std::pair<uint32_t, uint32_t>> sectors;  // sequence, sector
+    for (uint32_t s = 0; s < geometry.sectors; s++) {
+        Header header = ReadHeader(s);
+        if (header.Valid()) {
+            sectors.push_back({header.sequence, s});
+        }
+    }
+    std::sort(sectors.begin(), sectors.end());
+
+    for (const auto &[sequence, sector] : sectors) {
+        bool clean;
+        Scan(sector, clean, [&](uint8_t type, const uint8_t *payload, size_t length) {
+            if (type == TransitionRecord && length == 5) {
+                transition(GetU32(payload), payload[4]);
+            } else if (type == WindowRecord && length >= 5 && length == 5u + payload[4]) {
+                double t0 = GetU32(payload);
+                for (int i = 0; i < payload[4]; i++) {
+                    window(t0 + i * window_seconds, payload[5 + i] / 10.0f);
+                }
+            }
+        });
+    }
+}
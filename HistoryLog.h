@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Flash.h"
+#include "VanHeesModel.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/*
+ * Append-only sleep history for the watch's NOR flash: state transitions and
+ * per-window arm angle changes, kept in a ring of erase sectors so that the
+ * oldest nights are dropped when the ring is full and every sector is erased
+ * equally often.
+ *
+ * Each sector starts with a header:
+ *
+ *   uint32  magic        "SLH1"
+ *   uint32  sequence     increases by one for every sector opened
+ *   uint32  erase_count  erases of this sector, for wear statistics
+ *   uint32  check        magic ^ sequence ^ erase_count
+ *
+ * followed by records that do not cross sectors:
+ *
+ *   uint8   length       of the payload, 0xff (erased) ends the sector
+ *   uint8   type
+ *   uint8   payload[length]
+ *   uint16  crc          CRC-16/CCITT of length, type and payload
+ *
+ * A record is committed once it is programmed, and a record torn by a power
+ * loss fails its CRC. On recovery the newest sector is scanned up to the
+ * first bad record, and if anything but erased flash follows, appending
+ * resumes in a fresh sector instead of programming over it.
+ */
+class HistoryLog {
+public:
+    enum RecordType : uint8_t {
+        TransitionRecord = 1,  // uint32 time (s), uint8 state
+        WindowRecord = 2,  // uint32 time (s) of the first window, uint8 n, uint8 change[n] (0.1 degree)
+    };
+
+    static constexpr int windows_per_record = 60;
+    static constexpr double window_seconds = VanHeesModel<float>::seconds_per_update;
+
+    // Recovers the log from <flash>, or formats it if it holds none.
+    explicit HistoryLog(Flash &flash);
+
+    // Append a transition, committing any buffered windows first.
+    void AddTransition(double t, uint8_t state);
+
+    // Buffer the arm angle change of one window, committed in records of
+    // <windows_per_record>. A record holds consecutive windows only, so a
+    // gap in the windows commits the record first.
+    void AddWindow(double t, float change);
+
+    // Commit the buffered windows.
+    void Commit();
+
+    // Read back the history, oldest first. Window changes come back
+    // quantized to 0.1 degree, saturated at 25.5.
+    void Replay(const std::function<void(double t, uint8_t state)> &transition,
+                const std::function<void(double t, float change)> &window);
+
+    // Lifetime erases of the least and most worn sectors, from their headers.
+    void Wear(uint32_t &least, uint32_t &most);
+
+    uint64_t PayloadBytes() const { return payload_bytes; }
+    uint64_t Records() const { return records; }
+    uint64_t TornRecords() const { return torn; }  // found on recovery
+    uint64_t DroppedSectors() const { return dropped; }  // overwritten history
+
+private:
+    struct Header {
+        uint32_t magic, sequence, erase_count, check;
+        bool Valid() const;
+    };
+
+    Header ReadHeader(uint32_t sector);
+    // Scan the records of <sector> from its start. Returns the offset after
+    // the last good record, and sets <clean> if only erased flash follows.
+    uint32_t Scan(uint32_t sector, bool &clean, const std::function<void(uint8_t type, const uint8_t *payload,
+                                                                          size_t length)> &record);
+    void Append(uint8_t type, const uint8_t *payload, size_t length);
+    void OpenSector(uint32_t sector);
+
+    Flash &flash;
+    FlashGeometry geometry;
+    uint32_t head = 0;  // sector being appended to
+    uint32_t sequence = 0;
+    uint32_t offset = 0;  // append position in the head sector, 0 if none is open
+
+    std::vector<uint8_t> windows;  // payload of the record being buffered
+    uint32_t windows_t0 = 0;
+
+    uint64_t payload_bytes = 0;
+    uint64_t records = 0;
+    uint64_t torn = 0;
+    uint64_t dropped = 0;
+};
@@ -0,0 +1,145 @@
+#include "HrScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+HrScheduler::HrScheduler(const HrSchedulerConfig &config) : config(config) {}
+
+bool HrScheduler::Update(double t, float change, uint8_t state) {
+    started = false;
+    bool still = change <= config.motion_threshold;
+    still_windows = still ? still_windows + 1 : 0;
+    bool asleep = state == 1;
+
+    // events that are worth a measurement once the arm is still: a new
+    // state that has held for <settle_windows>, or the end of a movement in
+    // sleep
+    if (last_state < 0) {
+        last_state = state;  // the first state is not a change
+    } else if (state != last_state) {
+        last_state = state;
+        state_changed = true;
+        state_windows = 0;
+    }
+    if (state_changed && ++state_windows >= config.settle_windows) {
+        triggered = true;
+        state_changed = false;
+    }
+    if (asleep && !still) {
+        moved_in_sleep = true;
+    }
+    if (asleep && moved_in_sleep && still_windows == config.settle_windows) {
+        triggered = true;
+        moved_in_sleep = false;
+    }
+
+    if (remaining > 0) {
+        remaining--;
+        return true;
+    }
+
+    // while awake, events do not add to the regular rate
+    bool due = t >= next_due || (triggered && t - last_start >= (asleep ? config.min_interval : config.wake_interval));
+    if (!due) {
+        due_since = NAN;
+        return false;
+    }
+    if (std::isnan(due_since)) {
+        due_since = t;
+    }
+    if (!still && t - due_since < config.max_defer) {
+        return false;
+    }
+    if (!still && !asleep) {
+        // awake and still moving: the reading would be noise, try later
+        next_due = t + config.wake_interval;
+        due_since = NAN;
+        triggered = false;
+        return false;
+    }
+
+    // start a measurement with this window
+    remaining = std::max(1L, std::lround(config.measure_seconds / config.window_seconds)) - 1;
+    started = true;
+    last_start = t;
+    next_due = t + (asleep ? config.sleep_interval : config.wake_interval);
+    due_since = NAN;
+    triggered = false;
+    return true;
+}
+
+bool FixedHrSchedule::Update(double t, float, uint8_t) {
+    started = false;
+    if (remaining > 0) {
+        remaining--;
+        return true;
+    }
+    if (std::isnan(next)) {
+        next = t;
+    }
+    if (t < next) {
+        return false;
+    }
+    remaining = std::max(1L, std::lround(config.measure_seconds / config.window_seconds)) - 1;
+    started = true;
+    while (next <= t) {
+        next += interval;
+    }
+    return true;
+}
+
+void HrUsage::Add(double t, bool on, bool started, float change, uint8_t state) {
+    int64_t b = int64_t(std::floor(t / block));
+    if (b != current_block) {
+        EndBlock();
+        current_block = b;
+    }
+    block_asleep |= state == 1;
+
+    if (started && measuring) {
+        EndMeasurement();  // back to back with the previous one
+    }
+    if (on) {
+        on_seconds += config.window_seconds;
+        if (!measuring) {
+            measuring = true;
+            moved = false;
+            measurements++;
+        }
+        moved |= change > config.motion_threshold;
+    } else if (measuring) {
+        EndMeasurement();
+    }
+}
+
+void HrUsage::EndMeasurement() {
+    measuring = false;
+    if (moved) {
+        corrupted++;
+    } else {
+        block_covered = true;
+    }
+}
+
+void HrUsage::EndBlock() {
+    if (block_asleep) {
+        sleep_blocks++;
+        covered_blocks += block_covered;
+    }
+    block_asleep = block_covered = false;
+}
+
+void HrUsage::Finish() {
+    if (measuring) {
+        EndMeasurement();
+    }
+    EndBlock();
+}
+
+void HrUsage::Print(std::ostream &out, const char *label, double days, double power) const {
+    out << label << ": on " << on_seconds / days / 60 << " min per 24 h (" << 100 * on_seconds / (days * 86400)
+        << " %), " << on_seconds * power / 1000 / days << " J per 24 h, " << measurements / days
+        << " measurements per 24 h, " << corrupted << " of " << measurements << " with motion; sleep blocks covered "
+        << covered_blocks << " of " << sleep_blocks << std::endl;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <iosfwd>
+
+/*
+ * Duty cycling of the heart rate sensor from what the accelerometer pipeline
+ * already computes. Both schedules are driven once per tracker window with
+ * the arm angle change and the current state, and say whether the PPG
+ * sensor should be on for that window.
+ *
+ * The gated schedule measures rarely while awake and at a slow steady rate
+ * in sleep. It adds a measurement when the tracker settles into a new state,
+ * or when the arm settles after moving in sleep, where stages are likely to
+ * change. Due measurements wait for the arm to be still, since motion
+ * corrupts PPG readings, for up to <max_defer>; then a measurement in sleep
+ * is taken anyway and one while awake is skipped.
+ */
+
+struct HrSchedulerConfig {
+    double window_seconds = 5;
+    double measure_seconds = 30;  // sensor on time per measurement, including lock
+    double sleep_interval = 600;  // seconds between measurements in stable sleep
+    double wake_interval = 1800;
+    double min_interval = 120;  // before an event-triggered measurement in sleep
+    float motion_threshold = 5;  // degrees of arm angle change per window
+    int settle_windows = 6;  // still windows after motion that trigger a measurement
+    double max_defer = 300;  // seconds a due measurement waits for stillness
+};
+
+class HrScheduler {
+public:
+    explicit HrScheduler(const HrSchedulerConfig &config = {});
+
+    // Returns true if the sensor is on for the window ending at <t>.
+    bool Update(double t, float change, uint8_t state);
+
+    // Whether the last Update() started a measurement.
+    bool Started() const { return started; }
+
+private:
+    HrSchedulerConfig config;
+    bool started = false;
+    int remaining = 0;  // windows left in the current measurement
+    double last_start = -INFINITY;
+    double next_due = -INFINITY;
+    double due_since = NAN;  // when the pending measurement became due
+    int still_windows = 0;
+    bool moved_in_sleep = false;
+    int last_state = -1;
+    bool state_changed = false;  // and not settled yet
+    int state_windows = 0;  // windows in the new state
+    bool triggered = false;
+};
+
+// Baseline: a measurement every <interval>, whatever happens.
+class FixedHrSchedule {
+public:
+    FixedHrSchedule(const HrSchedulerConfig &config, double interval) : config(config), interval(interval) {}
+
+    bool Update(double t, float change, uint8_t state);
+    bool Started() const { return started; }
+
+private:
+    HrSchedulerConfig config;
+    double interval;
+    bool started = false;
+    double next = NAN;
+    int remaining = 0;
+};
+
+/*
+ * Sensor use of one schedule over a replay. A measurement is clean if the
+ * arm stayed still while the sensor was on. Sleep is split into blocks of
+ * <block> seconds, and a block is covered if a clean measurement ended in it.
+ */
+class HrUsage {
+public:
+    HrUsage(const HrSchedulerConfig &config, double block = 600) : config(config), block(block) {}
+
+    // <on> and <started> as returned by the schedule's Update() and Started().
+    void Add(double t, bool on, bool started, float change, uint8_t state);
+    void Finish();
+
+    // Per 24 h of <days> recorded, with the sensor drawing <power> mW.
+    void Print(std::ostream &out, const char *label, double days, double power) const;
+
+    double OnSeconds() const { return on_seconds; }
+
+private:
+    void EndMeasurement();
+    void EndBlock();
+
+    HrSchedulerConfig config;
+    double block;
+
+    double on_seconds = 0;
+    uint64_t measurements = 0;
+    uint64_t corrupted = 0;
+    bool measuring = false;
+    bool moved = false;
+
+    int64_t current_block = INT64_MIN;
+    bool block_asleep = false;
+    bool block_covered = false;
+    uint64_t sleep_blocks = 0;
+    uint64_t covered_blocks = 0;
+};
@@ -0,0 +1,285 @@
+#include "Hypnogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+    constexpr size_t header_size = 64;
+    constexpr size_t name_size = 56;
+
+    // Per-column counts for a block of words as vertical counters: bit i of
+    // every column's count lives in planes[i], so adding a row is a
+    // ripple-carry add of one word per column group. The inner loops run
+    // across the block and vectorize, and 64 columns are counted with a
+    // handful of bitwise operations per row.
+    template<size_t Block>
+    struct VerticalCounter {
+        uint64_t planes[32][Block] = {};
+
+        void Add(const uint64_t *x_in) {
+            uint64_t x[Block];
+            memcpy(x, x_in, sizeof(x));
+            for (int p = 0; p < 32; p++) {
+                uint64_t any = 0;
+                for (size_t i = 0; i < Block; i++) {
+                    uint64_t carry = planes[p][i] & x[i];
+                    planes[p][i] ^= x[i];
+                    x[i] = carry;
+                    any |= carry;
+                }
+                if (!any) {
+                    break;
+                }
+            }
+        }
+
+        uint32_t Count(size_t word, int bit) const {
+            uint32_t n = 0;
+            for (int p = 0; p < 32; p++) {
+                n |= uint32_t((planes[p][word] >> bit) & 1) << p;
+            }
+            return n;
+        }
+    };
+}
+
+void HypnogramRow::Set(size_t from, size_t to, bool asleep) {
+    to = std::min(to, sleep.size() * 64);
+    for (size_t c = from; c < to;) {
+        size_t w = c / 64;
+        size_t end = std::min(to, (w + 1) * 64);
+        uint64_t mask = (end - c == 64 ? ~uint64_t(0) : ((uint64_t(1) << (end - c)) - 1)) << (c % 64);
+        scored[w] |= mask;
+        if (asleep) {
+            sleep[w] |= mask;
+        } else {
+            sleep[w] &= ~mask;
+        }
+        c = end;
+    }
+}
+
+HypnogramWriter::HypnogramWriter(const std::string &path, double epoch, double day_start)
+    : path(path), file(std::fopen(path.c_str(), "wb")), epoch(epoch), day_start(day_start),
+      columns(size_t(std::ceil(86400 / epoch))), words((columns + 63) / 64) {
+    if (file) {
+        // header is written by Finish() once the number of rows is known
+        char header[header_size] = {};
+        std::fwrite(header, 1, header_size, file);
+    }
+}
+
+HypnogramWriter::~HypnogramWriter() {
+    if (file) {
+        std::fclose(file);
+    }
+}
+
+void HypnogramWriter::Add(const std::string &name, int64_t day, const HypnogramRow &row) {
+    names.push_back({name, day});
+    if (file) {
+        std::fwrite(row.sleep.data(), sizeof(uint64_t), words, file);
+        std::fwrite(row.scored.data(), sizeof(uint64_t), words, file);
+    }
+}
+
+void HypnogramWriter::AddTransitions(const std::string &name, const std::vector<std::pair<double, int>> &transitions,
+                                     double end) {
+    std::map<int64_t, HypnogramRow> days;
+    for (size_t i = 0; i < transitions.size(); i++) {
+        double from = transitions[i].first;
+        double to = i + 1 < transitions.size() ? transitions[i + 1].first : end;
+        bool asleep = transitions[i].second == 1;
+
+        // split the span at day boundaries
+        while (from < to) {
+            int64_t day = int64_t(std::floor((from - day_start) / 86400));
+            double day_origin = day_start + day * 86400.0;
+            double until = std::min(to, day_origin + 86400);
+            auto it = days.try_emplace(day, words).first;
+            it->second.Set(size_t((from - day_origin) / epoch), size_t(std::ceil((until - day_origin) / epoch)), asleep);
+            from = until;
+        }
+    }
+    for (const auto &[day, row] : days) {
+        Add(name, day, row);
+    }
+}
+
+bool HypnogramWriter::Finish() {
+    bool ok = file != nullptr;
+    if (ok) {
+        uint64_t names_offset = std::ftell(file);
+        for (const auto &[name, day] : names) {
+            char entry[name_size] = {};
+            memcpy(entry, name.data(), std::min(name.size(), name_size - 1));
+            std::fwrite(entry, 1, name_size, file);
+            std::fwrite(&day, sizeof(day), 1, file);
+        }
+
+        uint32_t c = columns, w = words;
+        uint64_t rows = names.size();
+        char header[header_size] = {};
+        memcpy(header, "HYPNOMAT", 8);
+        memcpy(header + 8, &c, 4);
+        memcpy(header + 12, &w, 4);
+        memcpy(header + 16, &epoch, 8);
+        memcpy(header + 24, &day_start, 8);
+        memcpy(header + 32, &rows, 8);
+        memcpy(header + 40, &names_offset, 8);
+        std::fseek(file, 0, SEEK_SET);
+        std::fwrite(header, 1, header_size, file);
+        ok = std::fclose(file) == 0;
+        file = nullptr;
+    }
+    if (!ok) {
+        std::cerr << "Unable to write '" << path << "'" << std::endl;
+    }
+    return ok;
+}
+
+HypnogramMatrix::HypnogramMatrix(int fd) : map(fd) {
+    const uint8_t *p = map.Data();
+    if (map.Size() < header_size || memcmp(p, "HYPNOMAT", 8) != 0) {
+        throw std::runtime_error("not a hypnogram matrix");
+    }
+    uint32_t c, w;
+    uint64_t names_offset;
+    memcpy(&c, p + 8, 4);
+    memcpy(&w, p + 12, 4);
+    memcpy(&epoch, p + 16, 8);
+    memcpy(&day_start, p + 24, 8);
+    memcpy(&rows, p + 32, 8);
+    memcpy(&names_offset, p + 40, 8);
+    columns = c;
+    words = w;
+    if (names_offset != header_size + rows * 2 * words * sizeof(uint64_t)
+        || map.Size() < names_offset + rows * (name_size + 8)) {
+        throw std::runtime_error("truncated hypnogram matrix");
+    }
+    bits = reinterpret_cast<const uint64_t *>(p + header_size);
+    names = p + names_offset;
+}
+
+std::string HypnogramMatrix::Name(uint64_t row) const {
+    const char *name = reinterpret_cast<const char *>(names + row * (name_size + 8));
+    return std::string(name, strnlen(name, name_size));
+}
+
+int64_t HypnogramMatrix::Day(uint64_t row) const {
+    int64_t day;
+    memcpy(&day, names + row * (name_size + 8) + name_size, 8);
+    return day;
+}
+
+#if defined(__x86_64__)
+__attribute__((target_clones("popcnt", "default")))
+#endif
+void HypnogramMatrix::Totals(uint64_t row, uint64_t &sleep, uint64_t &scored) const {
+    const uint64_t *s = Sleep(row), *m = Scored(row);
+    sleep = scored = 0;
+    for (size_t w = 0; w < words; w++) {
+        sleep += std::popcount(s[w] & m[w]);
+        scored += std::popcount(m[w]);
+    }
+}
+
+void HypnogramMatrix::Profile(std::vector<uint32_t> &sleep, std::vector<uint32_t> &scored) const {
+    sleep.assign(columns, 0);
+    scored.assign(columns, 0);
+
+    // a block of words at a time keeps the counters in L1
+    constexpr size_t block = 32;
+    auto sleep_counts = std::make_unique<VerticalCounter<block>>();
+    auto scored_counts = std::make_unique<VerticalCounter<block>>();
+    for (size_t w0 = 0; w0 < words; w0 += block) {
+        size_t n = std::min(block, words - w0);
+        *sleep_counts = {};
+        *scored_counts = {};
+        for (uint64_t r = 0; r < rows; r++) {
+            const uint64_t *s = Sleep(r) + w0, *m = Scored(r) + w0;
+            uint64_t asleep[block] = {}, valid[block] = {};
+            for (size_t i = 0; i < n; i++) {
+                asleep[i] = s[i] & m[i];
+                valid[i] = m[i];
+            }
+            sleep_counts->Add(asleep);
+            scored_counts->Add(valid);
+        }
+        for (size_t i = 0; i < n; i++) {
+            for (int bit = 0; bit < 64 && (w0 + i) * 64 + bit < columns; bit++) {
+                sleep[(w0 + i) * 64 + bit] = sleep_counts->Count(i, bit);
+                scored[(w0 + i) * 64 + bit] = scored_counts->Count(i, bit);
+            }
+        }
+    }
+}
+
+std::vector<uint64_t> HypnogramMatrix::Reduce(const std::vector<uint64_t> &selected, bool all) const {
+    std::vector<uint64_t> out(words, all ? ~uint64_t(0) : 0);
+    for (uint64_t r : selected) {
+        const uint64_t *s = Sleep(r), *m = Scored(r);
+        for (size_t w = 0; w < words; w++) {
+            // unscored epochs count as awake
+            out[w] = all ? out[w] & (s[w] & m[w]) : out[w] | (s[w] & m[w]);
+        }
+    }
+    return out;
+}
+
+bool CheckHypnogramNames(const std::vector<Night> &nights) {
+    for (const Night &night : nights) {
+        if (night.name.size() >= name_size) {
+            std::cerr << "Night name '" << night.name << "' is longer than " << name_size - 1
+                      << " bytes, the limit for the hypnogram matrix" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BuildHypnogram(const std::vector<Night> &nights, const std::string &out_dir, const std::string &path) {
+    if (!CheckHypnogramNames(nights)) {
+        return false;
+    }
+    HypnogramWriter writer(path);
+    for (const Night &night : nights) {
+        std::filesystem::path result = std::filesystem::path(out_dir) / (night.name + ".txt");
+        std::ifstream in(result);
+        if (!in) {
+            std::cerr << "Unable to open '" << result.string() << "'" << std::endl;
+            return false;
+        }
+
+        // TIME STATE lines, then score: lines and "# end TIME"
+        std::vector<std::pair<double, int>> transitions;
+        double end = -INFINITY;
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            double t;
+            int state;
+            std::string word;
+            if (line.starts_with("# end") && (fields >> word >> word >> t)) {
+                end = t;
+            } else if (!line.empty() && line[0] != '#' && !line.starts_with("score:") && (fields >> t >> state)) {
+                transitions.push_back({t, state != 0});
+            }
+        }
+        if (transitions.empty()) {
+            continue;
+        }
+        // results without an end stop at the last state change
+        writer.AddTransitions(night.name, transitions, std::max(end, transitions.back().first));
+    }
+    return writer.Finish();
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "Cohort.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * Cohort hypnograms as a bit matrix: one row per subject-day (noon to noon,
+ * clock time), one bit per 5 s epoch, in two planes: asleep, and scored (the
+ * tracker had an estimate for that epoch). A day is 17280 epochs, 270 words
+ * per plane, so a million nights take about 4 GB and are queried straight
+ * from the mapping with popcount and bitwise AND/OR across rows.
+ *
+ * File layout, little-endian:
+ *
+ *   char     magic[8]       "HYPNOMAT"
+ *   uint32   columns        epochs per row
+ *   uint32   words          64-bit words per plane per row
+ *   float64  epoch          seconds
+ *   float64  day_start      seconds after midnight where rows start
+ *   uint64   rows
+ *   uint64   names_offset   byte offset of the row names
+ *   uint8    pad[16]
+ *   uint64   bits[rows][2][words]   asleep plane, then scored plane
+ *   struct { char name[56]; int64 day; } names[rows]
+ */
+
+// Sleep and scored bits of one row under construction.
+struct HypnogramRow {
+    std::vector<uint64_t> sleep, scored;
+
+    explicit HypnogramRow(size_t words) : sleep(words), scored(words) {}
+
+    // Mark columns [from, to) as scored, and asleep if <asleep>.
+    void Set(size_t from, size_t to, bool asleep);
+};
+
+class HypnogramWriter {
+public:
+    HypnogramWriter(const std::string &path, double epoch = 5, double day_start = 12 * 3600);
+    ~HypnogramWriter();
+
+    HypnogramWriter(const HypnogramWriter &) = delete;
+    HypnogramWriter &operator=(const HypnogramWriter &) = delete;
+
+    size_t Columns() const { return columns; }
+    size_t Words() const { return words; }
+    double Epoch() const { return epoch; }
+    double DayStart() const { return day_start; }
+
+    void Add(const std::string &name, int64_t day, const HypnogramRow &row);
+
+    // Add the rows for one night from its TIME STATE transitions, up to
+    // <end>. Days are counted from the epoch of the time stamps.
+    void AddTransitions(const std::string &name, const std::vector<std::pair<double, int>> &transitions,
+                        double end);
+
+    // Returns false and prints an error on failure.
+    bool Finish();
+
+private:
+    std::string path;
+    std::FILE *file;
+    double epoch, day_start;
+    size_t columns, words;
+    std::vector<std::pair<std::string, int64_t>> names;
+};
+
+class HypnogramMatrix {
+public:
+    // Takes ownership of <fd>. Throws std::runtime_error if it is not a
+    // hypnogram matrix.
+    explicit HypnogramMatrix(int fd);
+
+    uint64_t Rows() const { return rows; }
+    size_t Columns() const { return columns; }
+    size_t Words() const { return words; }
+    double Epoch() const { return epoch; }
+    double DayStart() const { return day_start; }
+
+    const uint64_t *Sleep(uint64_t row) const { return bits + row * 2 * words; }
+    const uint64_t *Scored(uint64_t row) const { return bits + (row * 2 + 1) * words; }
+    std::string Name(uint64_t row) const;
+    int64_t Day(uint64_t row) const;
+
+    // Epochs asleep and scored in one row.
+    void Totals(uint64_t row, uint64_t &sleep, uint64_t &scored) const;
+
+    // Per column, the number of rows asleep and the number scored.
+    void Profile(std::vector<uint32_t> &sleep, std::vector<uint32_t> &scored) const;
+
+    // Bitwise AND (all asleep) or OR (any asleep) of the asleep plane of
+    // <rows>, one word per 64 columns.
+    std::vector<uint64_t> Reduce(const std::vector<uint64_t> &rows, bool all) const;
+
+private:
+    MappedFile map;
+    uint64_t rows;
+    size_t columns, words;
+    double epoch, day_start;
+    const uint64_t *bits;
+    const uint8_t *names;
+};
+
+// Write the matrix for the results of a cohort run in <out_dir>: each night
+// adds one row per day it covers. Epochs before the first state change and
+// after the end of the input are unscored. Returns false and prints an error
+// on failure.
+bool BuildHypnogram(const std::vector<Night> &nights, const std::string &out_dir, const std::string &path);
+
+// Check that every night's name fits in a row name, so names that share a
+// long prefix stay distinct. Returns false and prints an error otherwise.
+bool CheckHypnogramNames(const std::vector<Night> &nights);
@@ -0,0 +1,90 @@
+#include "KllSketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+KllSketch::KllSketch(int k) : k(k), levels(1) {}
+
+size_t KllSketch::Capacity(size_t level) const {
+    size_t depth = levels.size() - 1 - level;
+    return std::max<size_t>(2, size_t(std::ceil(k * std::pow(2.0 / 3.0, depth))));
+}
+
+size_t KllSketch::Retained() const {
+    size_t total = 0;
+    for (const auto &level : levels) {
+        total += level.size();
+    }
+    return total;
+}
+
+void KllSketch::Add(float x) {
+    levels[0].push_back(x);
+    n++;
+    if (levels[0].size() >= Capacity(0)) {
+        Compress();
+    }
+}
+
+void KllSketch::Merge(const KllSketch &other) {
+    if (other.levels.size() > levels.size()) {
+        levels.resize(other.levels.size());
+    }
+    for (size_t i = 0; i < other.levels.size(); i++) {
+        levels[i].insert(levels[i].end(), other.levels[i].begin(), other.levels[i].end());
+    }
+    n += other.n;
+    Compress();
+}
+
+void KllSketch::Compress() {
+    for (size_t i = 0; i < levels.size(); i++) {
+        if (levels[i].size() < Capacity(i)) {
+            continue;
+        }
+        if (i + 1 == levels.size()) {
+            levels.emplace_back();
+        }
+
+        // promote every other value of the sorted level, starting at a
+        // random offset; an odd one out stays behind
+        std::vector<float> &level = levels[i];
+        std::sort(level.begin(), level.end());
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        size_t keep = level.size() % 2;
+        for (size_t j = keep + (rng & 1); j < level.size(); j += 2) {
+            levels[i + 1].push_back(level[j]);
+        }
+        level.resize(keep);
+    }
+}
+
+float KllSketch::Quantile(double q) const {
+    std::vector<std::pair<float, uint64_t>> weighted;
+    for (size_t i = 0; i < levels.size(); i++) {
+        for (float x : levels[i]) {
+            weighted.push_back({x, uint64_t(1) << i});
+        }
+    }
+    if (weighted.empty()) {
+        return 0;
+    }
+    std::sort(weighted.begin(), weighted.end());
+
+    uint64_t total = 0;
+    for (const auto &w : weighted) {
+        total += w.second;
+    }
+    double target = q * total;
+    uint64_t cumulative = 0;
+    for (const auto &w : weighted) {
+        cumulative += w.second;
+        if (cumulative > target) {
+            return w.first;
+        }
+    }
+    return weighted.back().first;
+}
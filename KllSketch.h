@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Mergeable quantile sketch (Karnin, Lang and Liberty, 2016). Values are
+ * kept in levels of compactors; a full level is sorted and every other value
+ * is promoted to the next level with twice the weight. Level capacities
+ * shrink by 2/3 going down from the top, so the sketch holds about 3k values
+ * regardless of the stream length and the rank error is about 1.7/k.
+ * Sketches of parts of a stream merge into a sketch of the whole.
+ */
+class KllSketch {
+public:
+    explicit KllSketch(int k = 200);
+
+    void Add(float x);
+    void Merge(const KllSketch &other);
+
+    // Value at rank <q> (0..1) of everything added. 0 if empty.
+    float Quantile(double q) const;
+
+    uint64_t Count() const { return n; }
+    size_t Retained() const;
+
+private:
+    size_t Capacity(size_t level) const;
+    void Compress();
+
+    int k;
+    uint64_t n = 0;
+    std::vector<std::vector<float>> levels;
+    uint64_t rng = 0x9e3779b97f4a7c15;  // picks which half a compaction keeps
+};
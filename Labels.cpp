@@ -0,0 +1,242 @@
+#include "Labels.h"
+#include "FileDescriptor.h"
+#include "MappedFile.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+    constexpr size_t batch_labels = 256;
+
+    int EdfField(const char *p, size_t len) {
+        return atoi(std::string(p, len).c_str());
+    }
+
+    // Map an EDF+ hypnogram annotation to a stage, or return false if it is
+    // not a sleep stage annotation.
+    bool StageOf(std::string_view annotation, int &stage) {
+        constexpr std::string_view prefix = "Sleep stage ";
+        if (annotation == "Movement time") {
+            stage = -1;
+            return true;
+        }
+        if (annotation.substr(0, prefix.size()) != prefix || annotation.size() != prefix.size() + 1) {
+            return false;
+        }
+        switch (annotation.back()) {
+        case 'W': stage = 0; break;
+        case '1': stage = 1; break;
+        case '2': stage = 2; break;
+        case '3':
+        case '4': stage = 3; break;  // R&K stage 4 is N3 in AASM terms
+        case 'R': stage = 5; break;
+        default: stage = -1; break;
+        }
+        return true;
+    }
+
+    LabelBatches ReadTextLabels(FileDescriptor file) {
+        std::vector<Label> batch;
+        batch.reserve(batch_labels);
+        std::string pending;
+        char buf[64 * 1024];
+
+        while (true) {
+            ssize_t n = read(file.fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n > 0) {
+                pending.append(buf, n);
+            } else if (!pending.empty() && pending.back() != '\n') {
+                pending += '\n';  // last row without newline
+            }
+
+            size_t begin = 0, nl;
+            while ((nl = pending.find('\n', begin)) != std::string::npos) {
+                const char *p = pending.c_str() + begin;
+                char *next;
+                double t = strtod(p, &next);
+                if (next != p) {
+                    p = next;
+                    long stage = strtol(p, &next, 10);
+                    if (next != p) {
+                        batch.push_back({t, int(stage)});
+                    }
+                }
+                begin = nl + 1;
+            }
+            pending.erase(0, begin);
+
+            if (batch.size() >= batch_labels || (n <= 0 && !batch.empty())) {
+                co_yield std::span<const Label>(batch);
+                batch.clear();
+            }
+            if (n <= 0) {
+                break;
+            }
+        }
+    }
+}
+
+LabelBatches TextLabels(int fd) {
+    return ReadTextLabels(FileDescriptor(fd));
+}
+
+LabelBatches EdfAnnotations(int fd) {
+    MappedFile map(fd);
+    const char *file = reinterpret_cast<const char *>(map.Data());
+    std::string_view reserved(file + 192, map.Size() < 256 ? 0 : 5);
+    if (reserved != "EDF+C" && reserved != "EDF+D") {
+        throw std::runtime_error("not an EDF+ file");
+    }
+
+    size_t header_bytes = EdfField(file + 184, 8);
+    int records = EdfField(file + 236, 8);
+    int signals = EdfField(file + 252, 4);
+    if (signals <= 0 || header_bytes != 256 + 256 * size_t(signals) || map.Size() < header_bytes) {
+        throw std::runtime_error("invalid EDF header");
+    }
+
+    // signal headers are stored field by field for all signals
+    const char *labels = file + 256;
+    const char *samples = file + 256 + signals * (16 + 80 + 8 + 8 + 8 + 8 + 8 + 80);
+    int annotation_signal = -1;
+    size_t record_bytes = 0, annotation_offset = 0, annotation_bytes = 0;
+    for (int i = 0; i < signals; i++) {
+        size_t bytes = 2 * EdfField(samples + 8 * i, 8);
+        if (annotation_signal < 0 && std::string_view(labels + 16 * i, 15) == "EDF Annotations") {
+            annotation_signal = i;
+            annotation_offset = record_bytes;
+            annotation_bytes = bytes;
+        }
+        record_bytes += bytes;
+    }
+    if (annotation_signal < 0) {
+        throw std::runtime_error("no annotations in EDF file");
+    }
+    if (records < 0) {
+        records = (map.Size() - header_bytes) / record_bytes;
+    }
+
+    std::vector<Label> batch;
+    for (int r = 0; r < records; r++) {
+        const char *p = file + header_bytes + r * record_bytes + annotation_offset;
+        const char *end = p + annotation_bytes;
+        if (end > file + map.Size()) {
+            break;
+        }
+
+        // time-stamped annotation lists: +ONSET[\x15DURATION]\x14ANNOTATION\x14...\x14\0
+        while (p < end && (*p == '+' || *p == '-')) {
+            const char *tal_end = static_cast<const char *>(memchr(p, '\0', end - p));
+            if (!tal_end) {
+                break;
+            }
+            std::string_view tal(p, tal_end - p);
+            size_t first = tal.find('\x14');
+            if (first != std::string_view::npos) {
+                double onset = strtod(std::string(tal.substr(0, tal.find_first_of("\x14\x15"))).c_str(), nullptr);
+                size_t begin = first + 1, sep;
+                while ((sep = tal.find('\x14', begin)) != std::string_view::npos) {
+                    int stage;
+                    if (StageOf(tal.substr(begin, sep - begin), stage)) {
+                        batch.push_back({onset, stage});
+                    }
+                    begin = sep + 1;
+                }
+            }
+            p = tal_end + 1;
+        }
+
+        if (batch.size() >= batch_labels) {
+            co_yield std::span<const Label>(batch);
+            batch.clear();
+        }
+    }
+    if (!batch.empty()) {
+        co_yield std::span<const Label>(batch);
+    }
+}
+
+bool OpenLabels(const std::string &spec, LabelBatches &labels) {
+    std::string type = "text";
+    std::string location = spec;
+    size_t colon = spec.find(':');
+    // any other prefix is part of a plain text file path
+    if (colon != std::string::npos && (spec.compare(0, colon, "text") == 0 || spec.compare(0, colon, "edf") == 0)) {
+        type = spec.substr(0, colon);
+        location = spec.substr(colon + 1);
+    }
+
+    int fd = open(location.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Unable to open '" << spec << "': " << strerror(errno) << std::endl;
+        return false;
+    }
+    labels = type == "edf" ? EdfAnnotations(fd) : TextLabels(fd);
+    return true;
+}
+
+LabelCursor::LabelCursor(LabelBatches labels, double offset) : labels(std::move(labels)), offset(offset) {}
+
+void LabelCursor::Fetch() {
+    while (!done && pos >= batch.size()) {
+        if (!labels.Next()) {
+            done = true;
+            return;
+        }
+        batch = labels.Value();
+        pos = 0;
+    }
+}
+
+int LabelCursor::At(double t) {
+    Fetch();
+    if (!started && !done) {
+        stage = batch[pos].stage;
+        started = true;
+    }
+    while (!done && batch[pos].t + offset < t) {
+        stage = batch[pos].stage;
+        pos++;
+        Fetch();
+    }
+    return stage;
+}
+
+void SleepScore::Add(int state, int stage) {
+    if (stage < 0 || state < 0) {
+        unscored++;
+    } else if (stage > 0) {
+        (state ? sleep_sleep : sleep_wake)++;
+    } else {
+        (state ? wake_sleep : wake_wake)++;
+    }
+}
+
+void SleepScore::Print(std::ostream &out) const {
+    uint64_t scored = sleep_sleep + sleep_wake + wake_sleep + wake_wake;
+    out << "score: samples " << scored << ", unscored " << unscored << std::endl;
+    if (scored == 0) {
+        return;
+    }
+    out << "score: truth sleep: estimated sleep " << sleep_sleep << ", wake " << sleep_wake << std::endl;
+    out << "score: truth wake:  estimated sleep " << wake_sleep << ", wake " << wake_wake << std::endl;
+    out << "score: accuracy " << 100.0 * (sleep_sleep + wake_wake) / scored << " %";
+    if (sleep_sleep + sleep_wake) {
+        out << ", sensitivity " << 100.0 * sleep_sleep / (sleep_sleep + sleep_wake) << " %";
+    }
+    if (wake_sleep + wake_wake) {
+        out << ", specificity " << 100.0 * wake_wake / (wake_sleep + wake_wake) << " %";
+    }
+    out << std::endl;
+}
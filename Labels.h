@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Generator.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <span>
+#include <string>
+
+/*
+ * Ground-truth sleep stage labels, read from their original files as a
+ * separate timestamp-sorted stream and aligned to samples on the fly, so the
+ * truth does not have to be merged into every replay file.
+ *
+ * Stages follow the PhysioNet sleep-accel labels: -1 unscored, 0 wake,
+ * 1-3 NREM and 5 REM.
+ */
+
+struct Label {
+    double t;  // seconds, start of the stage
+    int stage;
+};
+
+using LabelBatches = Generator<std::span<const Label>>;
+
+// "TIME STAGE" rows, as in PhysioNet's <subject>_labeled_sleep.txt. Closes
+// <fd> when done.
+LabelBatches TextLabels(int fd);
+
+// Sleep stage annotations ("Sleep stage W", "Sleep stage 2", "Sleep stage R",
+// ...) from an EDF+ file such as the Sleep-EDF hypnograms. Onsets are seconds
+// from the start of the recording. Closes <fd> when done. Throws
+// std::runtime_error if the file is not EDF+ with an annotation signal.
+LabelBatches EdfAnnotations(int fd);
+
+// Open labels from a spec of the form [TYPE:]FILE with TYPE text (default)
+// or edf; any other prefix is part of the file name. Prints an error and
+// returns false if the file could not be opened.
+bool OpenLabels(const std::string &spec, LabelBatches &labels);
+
+// Looks up the stage for sample times in increasing order, holding each
+// label until the next one like stimuli() in vanhees2015.py: a sample gets
+// the last label before it, or the first label if there is none.
+class LabelCursor {
+public:
+    LabelCursor(LabelBatches labels, double offset = 0);
+
+    int At(double t);
+
+private:
+    void Fetch();
+
+    LabelBatches labels;
+    double offset;
+    std::span<const Label> batch;
+    size_t pos = 0;
+    bool done = false;
+    bool started = false;
+    int stage = -1;
+};
+
+// Per-sample agreement between tracker state (0 wake, 1 sleep) and truth,
+// where any stage above wake counts as sleep and unscored samples are left
+// out.
+struct SleepScore {
+    uint64_t sleep_sleep = 0;  // truth, estimate
+    uint64_t sleep_wake = 0;
+    uint64_t wake_sleep = 0;
+    uint64_t wake_wake = 0;
+    uint64_t unscored = 0;
+
+    void Add(int state, int stage);
+    void Print(std::ostream &out) const;
+};
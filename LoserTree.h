@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/*
+ * Tournament tree of losers for k-way merging. Each internal node holds the
+ * loser of the match played there and node 0 holds the overall winner, so
+ * replacing the winner's key costs one comparison per tree level, i.e.
+ * O(log k), and the tree itself is O(k).
+ *
+ * <Less>(a, b) compares leaf indices and must order exhausted leaves last.
+ * Ties should be broken by index to keep the merge stable.
+ */
+template <typename Less>
+class LoserTree {
+public:
+    LoserTree(size_t leaves, Less less) : k(leaves), less(less), tree(leaves ? leaves : 1) {
+        if (k == 0) {
+            return;
+        }
+
+        // leaves live at k..2k-1; play every match bottom-up once
+        std::vector<size_t> winners(2 * k);
+        for (size_t i = 0; i < k; i++) {
+            winners[k + i] = i;
+        }
+        for (size_t node = k - 1; node > 0; node--) {
+            size_t a = winners[2 * node];
+            size_t b = winners[2 * node + 1];
+            if (this->less(b, a)) {
+                std::swap(a, b);
+            }
+            winners[node] = a;
+            tree[node] = b;
+        }
+        tree[0] = winners[1];
+    }
+
+    size_t Winner() const { return tree[0]; }
+
+    // Call after the key of the current winner has changed.
+    void Replay() {
+        size_t winner = tree[0];
+        for (size_t node = (winner + k) / 2; node > 0; node /= 2) {
+            if (less(tree[node], winner)) {
+                std::swap(tree[node], winner);
+            }
+        }
+        tree[0] = winner;
+    }
+
+private:
+    size_t k;
+    Less less;
+    std::vector<size_t> tree;
+};
@@ -0,0 +1,39 @@
+#include "MappedFile.h"
+#include "MemoryProfile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(int fd) : fd(fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw std::runtime_error(std::string("unable to stat file: ") + strerror(errno));
+    }
+    size = st.st_size;
+    if (size == 0) {
+        return;
+    }
+
+    void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error(std::string("unable to map file: ") + strerror(errno));
+    }
+    madvise(p, size, MADV_SEQUENTIAL);
+    data = static_cast<const uint8_t *>(p);
+}
+
+MappedFile::~MappedFile() {
+    if (data) {
+        NoteMappedResident(data, size);
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+    close(fd);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Read-only memory mapping of a whole file. Takes ownership of <fd> and
+// closes it together with the mapping. Throws std::runtime_error if the file
+// cannot be mapped.
+class MappedFile {
+public:
+    explicit MappedFile(int fd);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    int fd;
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+};
@@ -0,0 +1,182 @@
+#include "MemoryProfile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include <malloc.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+bool memory_profiling = false;
+
+namespace {
+    // Plain zero-initialized globals without constructors, so the replaced
+    // operator new can safely touch them before main runs.
+    std::atomic<uint64_t> stage_bytes[MemoryStages];
+    std::atomic<uint64_t> stage_count[MemoryStages];
+    std::atomic<int64_t> live_bytes;
+    std::atomic<int64_t> peak_live_bytes;
+    std::atomic<uint64_t> mapped_bytes;
+    std::atomic<uint64_t> mapped_resident;
+    std::atomic<uint64_t> peak_mapped_resident;
+
+    thread_local MemoryStage current_stage = OtherStage;
+
+    const char *stage_names[MemoryStages] = {"other", "input", "decode", "merge", "tracker", "analysis", "output"};
+
+    void *Counted(void *p) {
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        if (!memory_profiling) {
+            return p;
+        }
+        size_t size = malloc_usable_size(p);
+        stage_bytes[current_stage].fetch_add(size, std::memory_order_relaxed);
+        stage_count[current_stage].fetch_add(1, std::memory_order_relaxed);
+        int64_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+        int64_t peak = peak_live_bytes.load(std::memory_order_relaxed);
+        while (live > peak && !peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+        }
+        return p;
+    }
+
+    void Release(void *p) {
+        if (p && memory_profiling) {
+            live_bytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+        }
+        free(p);
+    }
+
+    double MiB(double bytes) {
+        return bytes / (1 << 20);
+    }
+}
+
+void *operator new(size_t size) {
+    return Counted(malloc(size ? size : 1));
+}
+
+void *operator new[](size_t size) {
+    return Counted(malloc(size ? size : 1));
+}
+
+void *operator new(size_t size, std::align_val_t align) {
+    size_t a = static_cast<size_t>(align);
+    return Counted(aligned_alloc(a, (std::max<size_t>(size, 1) + a - 1) / a * a));
+}
+
+void *operator new[](size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+void operator delete(void *p) noexcept {
+    Release(p);
+}
+
+void operator delete[](void *p) noexcept {
+    Release(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    Release(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    Release(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    Release(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+    Release(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    Release(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+    Release(p);
+}
+
+MemoryStageScope::MemoryStageScope(MemoryStage stage) : previous(current_stage) {
+    current_stage = stage;
+}
+
+MemoryStageScope::~MemoryStageScope() {
+    End();
+}
+
+void MemoryStageScope::End() {
+    if (!ended) {
+        current_stage = previous;
+        ended = true;
+    }
+}
+
+void NoteMappedResident(const void *data, size_t size) {
+    if (!memory_profiling) {
+        return;
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> pages((size + page - 1) / page);
+    if (mincore(const_cast<void *>(data), size, pages.data()) < 0) {
+        return;
+    }
+    uint64_t resident = page * std::count_if(pages.begin(), pages.end(), [](unsigned char p) { return p & 1; });
+    mapped_bytes += size;
+    mapped_resident += resident;
+    uint64_t peak = peak_mapped_resident.load();
+    while (resident > peak && !peak_mapped_resident.compare_exchange_weak(peak, resident)) {
+    }
+}
+
+uint64_t CurrentRss() {
+    long pages[2] = {};
+    if (std::FILE *f = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(f, "%ld %ld", &pages[0], &pages[1]) != 2) {
+            pages[1] = 0;
+        }
+        std::fclose(f);
+    }
+    return uint64_t(pages[1]) * sysconf(_SC_PAGESIZE);
+}
+
+void MemoryReport(std::ostream &out, uint64_t baseline_rss, uint64_t input_bytes) {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    uint64_t peak_rss = uint64_t(usage.ru_maxrss) * 1024;
+
+    out << "memory: peak rss " << MiB(peak_rss) << " MiB, baseline " << MiB(baseline_rss) << " MiB" << std::endl;
+    out << "memory: heap peak " << MiB(peak_live_bytes) << " MiB, live at exit " << MiB(std::max<int64_t>(live_bytes, 0)) << " MiB"
+        << std::endl;
+    for (int stage = 0; stage < MemoryStages; stage++) {
+        out << "memory: allocated by " << stage_names[stage] << ": " << MiB(stage_bytes[stage]) << " MiB in "
+            << stage_count[stage] << " allocations" << std::endl;
+    }
+    if (mapped_bytes > 0) {
+        out << "memory: mapped " << MiB(mapped_bytes) << " MiB, resident when unmapped " << MiB(mapped_resident)
+            << " MiB, largest single mapping resident " << MiB(peak_mapped_resident) << " MiB" << std::endl;
+    }
+
+    // Streaming stages use a fixed amount of heap, so what grows with the
+    // input is the page cache held by mappings and anything else the RSS
+    // picked up beyond the baseline and heap.
+    double fixed = baseline_rss + peak_live_bytes;
+    double per_gib = 0;
+    if (input_bytes > 0) {
+        double variable = std::max(0.0, double(peak_rss) - fixed);
+        per_gib = variable / (input_bytes / double(1 << 30));
+    }
+    out << "memory: estimate per job " << MiB(fixed) << " MiB + " << MiB(per_gib)
+        << " MiB per GiB of input (" << MiB(input_bytes) << " MiB here)" << std::endl;
+}
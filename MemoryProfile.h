@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+/*
+ * Memory accounting for sizing batch jobs. Global operator new and delete
+ * are replaced to count bytes allocated per stage of the replay, tagged by
+ * the MemoryStageScope active on the allocating thread, and the live and
+ * peak heap size. Memory-mapped inputs are not on the heap; MappedFile
+ * reports how much of each mapping was resident when it is unmapped.
+ *
+ * Nothing is counted until memory_profiling is set, and the replaced
+ * operators go straight to malloc and free until then. Set it before the
+ * replay starts: blocks allocated earlier and freed later make the live size
+ * slightly low.
+ */
+
+extern bool memory_profiling;
+
+enum MemoryStage {
+    OtherStage,
+    InputStage,  // read and parse buffers
+    DecodeStage,  // binary format decoding
+    MergeStage,
+    TrackerStage,  // tracker and reference models
+    AnalysisStage,  // detectors, stores and simulators fed by the replay
+    OutputStage,
+    MemoryStages,
+};
+
+// Tags allocations on this thread with <stage> until destroyed.
+class MemoryStageScope {
+public:
+    explicit MemoryStageScope(MemoryStage stage);
+    ~MemoryStageScope();
+
+    // Restore the previous stage before the scope ends.
+    void End();
+
+    MemoryStageScope(const MemoryStageScope &) = delete;
+    MemoryStageScope &operator=(const MemoryStageScope &) = delete;
+
+private:
+    MemoryStage previous;
+    bool ended = false;
+};
+
+// Record the resident size of a mapping that is about to be unmapped.
+void NoteMappedResident(const void *data, size_t size);
+
+// Current resident set size in bytes, from /proc/self/statm.
+uint64_t CurrentRss();
+
+// Print peak RSS, heap use per stage, mapped residency and an estimate of the
+// memory needed per job, given the RSS before any input was read and the
+// total size of the input files.
+void MemoryReport(std::ostream &out, uint64_t baseline_rss, uint64_t input_bytes);
@@ -0,0 +1,227 @@
+#include "Metrics.h"
+#include "FileDescriptor.h"
+
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <variant>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+bool metrics_enabled = false;
+
+namespace {
+    struct Metric {
+        std::string name;
+        std::string help;
+        std::variant<Counter, Gauge, Histogram> value;
+
+        template <typename T>
+        Metric(const std::string &name, const std::string &help, std::in_place_type_t<T> type)
+            : name(name), help(help), value(type) {}
+    };
+
+    // deque, so registered metrics never move. Constructed on first use, as
+    // metrics are registered during static initialization of other files.
+    struct Registry {
+        std::mutex mutex;
+        std::deque<Metric> metrics;
+    };
+
+    Registry &TheRegistry() {
+        static Registry registry;
+        return registry;
+    }
+
+    template <typename T>
+    T &Register(const std::string &name, const std::string &help) {
+        Registry &registry = TheRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (Metric &m : registry.metrics) {
+            if (m.name == name) {
+                if (!std::holds_alternative<T>(m.value)) {
+                    throw std::runtime_error("metric '" + name + "' registered with another type");
+                }
+                return std::get<T>(m.value);
+            }
+        }
+        return std::get<T>(registry.metrics.emplace_back(name, help, std::in_place_type<T>).value);
+    }
+}
+
+int MetricShard() {
+    static std::atomic<int> next {0};
+    thread_local int shard = next++ % metric_shards;
+    return shard;
+}
+
+uint64_t Counter::Value() const {
+    uint64_t total = 0;
+    for (const Slot &slot : slots) {
+        total += slot.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void Histogram::Collect(std::array<uint64_t, buckets> &cumulative, uint64_t &count, double &sum_seconds) const {
+    cumulative.fill(0);
+    uint64_t sum_ns = 0;
+    for (const Slot &slot : slots) {
+        for (int i = 0; i < buckets; i++) {
+            cumulative[i] += slot.counts[i].load(std::memory_order_relaxed);
+        }
+        sum_ns += slot.sum_ns.load(std::memory_order_relaxed);
+    }
+    for (int i = 1; i < buckets; i++) {
+        cumulative[i] += cumulative[i - 1];
+    }
+    count = cumulative[buckets - 1];
+    sum_seconds = sum_ns * 1e-9;
+}
+
+Counter &NewCounter(const std::string &name, const std::string &help) {
+    return Register<Counter>(name, help);
+}
+
+Gauge &NewGauge(const std::string &name, const std::string &help) {
+    return Register<Gauge>(name, help);
+}
+
+Histogram &NewHistogram(const std::string &name, const std::string &help) {
+    return Register<Histogram>(name, help);
+}
+
+void WriteMetrics(std::ostream &out) {
+    Registry &registry = TheRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const Metric &m : registry.metrics) {
+        out << "# HELP " << m.name << " " << m.help << "\n";
+        if (const Counter *c = std::get_if<Counter>(&m.value)) {
+            out << "# TYPE " << m.name << " counter\n";
+            out << m.name << " " << c->Value() << "\n";
+        } else if (const Gauge *g = std::get_if<Gauge>(&m.value)) {
+            out << "# TYPE " << m.name << " gauge\n";
+            out << m.name << " " << g->Value() << "\n";
+        } else if (const Histogram *h = std::get_if<Histogram>(&m.value)) {
+            std::array<uint64_t, Histogram::buckets> cumulative;
+            uint64_t count;
+            double sum;
+            h->Collect(cumulative, count, sum);
+            out << "# TYPE " << m.name << " histogram\n";
+            // bucket i holds durations below 2^i ns
+            for (int i = 0; i < Histogram::buckets - 1; i++) {
+                out << m.name << "_bucket{le=\"" << double(uint64_t(1) << i) * 1e-9 << "\"} " << cumulative[i] << "\n";
+            }
+            out << m.name << "_bucket{le=\"+Inf\"} " << count << "\n";
+            out << m.name << "_sum " << sum << "\n";
+            out << m.name << "_count " << count << "\n";
+        }
+    }
+}
+
+MetricsServer::MetricsServer(const std::string &spec) {
+    std::string type = spec.substr(0, spec.find(':'));
+    std::string location = spec.find(':') == std::string::npos ? "" : spec.substr(spec.find(':') + 1);
+
+    // Close the socket, if any, before reporting a failure.
+    auto fail = [this](const std::string &message) {
+        std::string error = message + strerror(errno);
+        if (listener >= 0) {
+            close(listener);
+        }
+        throw std::runtime_error(error);
+    };
+
+    if (type == "tcp") {
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(atoi(location.c_str()));
+        listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listener < 0) {
+            fail("unable to create socket: ");
+        }
+        int one = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+            fail("unable to listen on port " + location + ": ");
+        }
+    } else if (type == "unix") {
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        if (location.size() >= sizeof(addr.sun_path)) {
+            throw std::runtime_error("socket path '" + location + "' is too long");
+        }
+        strcpy(addr.sun_path, location.c_str());
+        unlink(location.c_str());
+        listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listener < 0) {
+            fail("unable to create socket: ");
+        }
+        if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+            fail("unable to listen on '" + location + "': ");
+        }
+        unix_path = location;
+    } else {
+        throw std::runtime_error("metrics address must be tcp:PORT or unix:PATH");
+    }
+    if (listen(listener, 16) < 0) {
+        fail("unable to listen: ");
+    }
+
+    metrics_enabled = true;
+    thread = std::thread(&MetricsServer::Serve, this);
+}
+
+MetricsServer::~MetricsServer() {
+    stop = true;
+    thread.join();
+    close(listener);
+    if (!unix_path.empty()) {
+        unlink(unix_path.c_str());
+    }
+    metrics_enabled = false;
+}
+
+void MetricsServer::Serve() {
+    while (!stop) {
+        // wake up regularly to notice <stop>
+        pollfd p {listener, POLLIN, 0};
+        if (poll(&p, 1, 200) <= 0) {
+            continue;
+        }
+        int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        FileDescriptor closer {fd};
+
+        // the request itself does not matter, every path gets the metrics
+        char request[1024];
+        pollfd c {fd, POLLIN, 0};
+        if (poll(&c, 1, 1000) > 0) {
+            recv(fd, request, sizeof(request), 0);
+        }
+
+        std::ostringstream body;
+        WriteMetrics(body);
+        std::string text = body.str();
+        std::string response = "HTTP/1.0 200 OK\r\n"
+                               "Content-Type: text/plain; version=0.0.4\r\n"
+                               "Content-Length: " + std::to_string(text.size()) + "\r\n\r\n" + text;
+        for (size_t sent = 0; sent < response.size();) {
+            ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                break;
+            }
+            sent += n;
+        }
+    }
+}
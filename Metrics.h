@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <thread>
+
+/*
+ * Live metrics for long-running modes, served in the Prometheus text format.
+ * Counters and histograms are sharded: each thread updates its own
+ * cache-line-sized slot with a relaxed atomic add, and slots are only summed
+ * when the metrics are read, so updates from different threads never contend.
+ * Metrics are registered once, by name, and live for the whole process.
+ */
+
+extern bool metrics_enabled;  // set while a MetricsServer is running
+
+constexpr int metric_shards = 16;
+
+// Shard of the calling thread, assigned round-robin on first use.
+int MetricShard();
+
+class Counter {
+public:
+    void Add(uint64_t n = 1) { slots[MetricShard()].value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t Value() const;
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> value {0};
+    };
+    std::array<Slot, metric_shards> slots;
+};
+
+class Gauge {
+public:
+    void Set(double v) { value.store(v, std::memory_order_relaxed); }
+    double Value() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> value {0};
+};
+
+// Latency histogram with power-of-two nanosecond buckets, as in
+// LatencyHistogram.
+class Histogram {
+public:
+    static constexpr int buckets = 32;  // the last one also takes everything above 2^31 ns
+
+    void Observe(std::chrono::nanoseconds d) {
+        uint64_t ns = d.count() > 0 ? d.count() : 0;
+        Slot &slot = slots[MetricShard()];
+        slot.counts[std::min<int>(std::bit_width(ns), buckets - 1)].fetch_add(1, std::memory_order_relaxed);
+        slot.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    // Cumulative counts per bucket, total count and sum of all observations.
+    void Collect(std::array<uint64_t, buckets> &cumulative, uint64_t &count, double &sum_seconds) const;
+
+private:
+    struct alignas(64) Slot {
+        std::array<std::atomic<uint64_t>, buckets> counts {};
+        std::atomic<uint64_t> sum_ns {0};
+    };
+    std::array<Slot, metric_shards> slots;
+};
+
+// Find or create the metric with the given name. References stay valid for
+// the life of the process.
+Counter &NewCounter(const std::string &name, const std::string &help);
+Gauge &NewGauge(const std::string &name, const std::string &help);
+Histogram &NewHistogram(const std::string &name, const std::string &help);
+
+// Write every registered metric in the Prometheus text format.
+void WriteMetrics(std::ostream &out);
+
+// Serves the metrics over HTTP on a background thread, at "tcp:PORT"
+// (loopback only) or "unix:PATH". Throws std::runtime_error if it cannot
+// listen there.
+class MetricsServer {
+public:
+    explicit MetricsServer(const std::string &spec);
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer &operator=(const MetricsServer &) = delete;
+
+private:
+    void Serve();
+
+    int listener;
+    std::string unix_path;
+    std::atomic<bool> stop {false};
+    std::thread thread;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+/*
+ * Scalar wrapper that tallies the arithmetic it performs. Instantiating
+ * VanHeesModel<OpCount<float>> gives the number of operations per sample,
+ * which CostModel turns into estimated cycles and current on the watch.
+ */
+struct OpCounts {
+    uint64_t add = 0;  // also counts subtraction
+    uint64_t mul = 0;
+    uint64_t div = 0;
+    uint64_t cmp = 0;
+    uint64_t sqrt = 0;
+    uint64_t atan = 0;
+
+    OpCounts operator-(const OpCounts &o) const {
+        return {add - o.add, mul - o.mul, div - o.div, cmp - o.cmp, sqrt - o.sqrt, atan - o.atan};
+    }
+    OpCounts &operator+=(const OpCounts &o) {
+        add += o.add;
+        mul += o.mul;
+        div += o.div;
+        cmp += o.cmp;
+        sqrt += o.sqrt;
+        atan += o.atan;
+        return *this;
+    }
+
+    // Counters shared by every OpCount value on this thread.
+    static OpCounts &Current() {
+        static thread_local OpCounts counts;
+        return counts;
+    }
+};
+
+template <typename T>
+struct OpCount {
+    T v {};
+
+    OpCount() = default;
+    OpCount(T v) : v(v) {}
+    explicit operator T() const { return v; }
+
+    friend OpCount operator+(OpCount a, OpCount b) { OpCounts::Current().add++; return a.v + b.v; }
+    friend OpCount operator-(OpCount a, OpCount b) { OpCounts::Current().add++; return a.v - b.v; }
+    friend OpCount operator*(OpCount a, OpCount b) { OpCounts::Current().mul++; return a.v * b.v; }
+    friend OpCount operator/(OpCount a, OpCount b) { OpCounts::Current().div++; return a.v / b.v; }
+
+    friend bool operator<(OpCount a, OpCount b) { OpCounts::Current().cmp++; return a.v < b.v; }
+    friend bool operator>(OpCount a, OpCount b) { OpCounts::Current().cmp++; return a.v > b.v; }
+    friend bool operator<=(OpCount a, OpCount b) { OpCounts::Current().cmp++; return a.v <= b.v; }
+    friend bool operator>=(OpCount a, OpCount b) { OpCounts::Current().cmp++; return a.v >= b.v; }
+
+    friend OpCount sqrt(OpCount a) { OpCounts::Current().sqrt++; return std::sqrt(a.v); }
+    friend OpCount atan(OpCount a) { OpCounts::Current().atan++; return std::atan(a.v); }
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+/*
+ * Streaming quantile estimate with the P-square algorithm (Jain and
+ * Chlamtac, 1985): five markers track the minimum, the p/2, p and (1+p)/2
+ * quantiles and the maximum, and are moved along a parabola fitted through
+ * their neighbours as observations arrive. Memory and cost per observation
+ * are constant, with no allocation, so it can run on the watch.
+ *
+ * Templated over the scalar type like VanHeesModel, so its arithmetic can be
+ * counted with OpCount.
+ */
+template <typename T>
+class P2Quantile {
+public:
+    explicit P2Quantile(float p = 0.5f) : p(p) {}
+
+    void Add(T x) {
+        if (count < 5) {
+            // keep the first five sorted, they become the initial markers
+            int i = count++;
+            for (; i > 0 && x < q[i - 1]; i--) {
+                q[i] = q[i - 1];
+            }
+            q[i] = x;
+            return;
+        }
+        count++;
+
+        int k;
+        if (x < q[0]) {
+            q[0] = x;
+            k = 0;
+        } else if (x < q[1]) {
+            k = 0;
+        } else if (x < q[2]) {
+            k = 1;
+        } else if (x < q[3]) {
+            k = 2;
+        } else if (x <= q[4]) {
+            k = 3;
+        } else {
+            q[4] = x;
+            k = 3;
+        }
+        for (int i = k + 1; i < 5; i++) {
+            n[i]++;
+        }
+
+        // desired marker positions, 0-based: (count - 1) * {0, p/2, p, (1+p)/2, 1}
+        const float m = float(count - 1);
+        const float desired[5] = {0, m * p / 2, m * p, m * (1 + p) / 2, m};
+        for (int i = 1; i < 4; i++) {
+            float d = desired[i] - n[i];
+            if ((d >= 1 && n[i + 1] - n[i] > 1) || (d <= -1 && n[i - 1] - n[i] < -1)) {
+                int s = d > 0 ? 1 : -1;
+                T h = Parabolic(i, s);
+                if (q[i - 1] < h && h < q[i + 1]) {
+                    q[i] = h;
+                } else {
+                    q[i] = q[i] + T(float(s)) * (q[i + s] - q[i]) / T(float(n[i + s] - n[i]));
+                }
+                n[i] += s;
+            }
+        }
+    }
+
+    // The current estimate; exact while fewer than five values were added.
+    T Value() const {
+        if (count == 0) {
+            return T();
+        }
+        if (count <= 5) {
+            return q[int(p * (count - 1) + 0.5f)];
+        }
+        return q[2];
+    }
+
+    uint64_t Count() const { return count; }
+
+private:
+    T Parabolic(int i, int s) const {
+        const T d = T(float(s));
+        const T a = T(float(n[i] - n[i - 1] + s)) * (q[i + 1] - q[i]) / T(float(n[i + 1] - n[i]));
+        const T b = T(float(n[i + 1] - n[i] - s)) * (q[i] - q[i - 1]) / T(float(n[i] - n[i - 1]));
+        return q[i] + d * (a + b) / T(float(n[i + 1] - n[i - 1]));
+    }
+
+    float p;
+    uint64_t count = 0;
+    std::array<T, 5> q {};  // marker heights
+    std::array<int64_t, 5> n {0, 1, 2, 3, 4};  // marker positions
+};
@@ -0,0 +1,93 @@
+#include "PacedReplay.h"
+
+#include <bit>
+#include <iostream>
+
+void LatencyHistogram::Add(Clock::duration d) {
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    int bucket = std::bit_width(ns);
+    if (bucket >= buckets) {
+        bucket = buckets - 1;
+    }
+    counts[bucket]++;
+    n++;
+    total += d;
+    if (d > max) {
+        max = d;
+    }
+}
+
+void LatencyHistogram::Print(std::ostream &out, const char *label) const {
+    using std::chrono::duration;
+    using us = duration<double, std::micro>;
+
+    out << label << ": n " << n;
+    if (n == 0) {
+        out << std::endl;
+        return;
+    }
+    out << ", mean " << us(total).count() / n << " us"
+        << ", max " << us(max).count() << " us" << std::endl;
+
+    for (int i = 0; i < buckets; i++) {
+        if (counts[i] == 0) {
+            continue;
+        }
+        // bucket i holds durations in [2^(i-1), 2^i) ns
+        double upper = us(std::chrono::nanoseconds(uint64_t(1) << i)).count();
+        out << "  < " << upper << " us: " << counts[i] << std::endl;
+    }
+}
+
+Pacer::Pacer(Clock::duration period) : period(period) {}
+
+void Pacer::WaitRelease() {
+    if (!started) {
+        next = Clock::now();
+        started = true;
+    }
+    std::this_thread::sleep_until(next);
+
+    released = Clock::now();
+    jitter.Add(released - next);
+}
+
+void Pacer::Done() {
+    Clock::time_point done = Clock::now();
+    latency.Add(done - released);
+    batches++;
+
+    // the deadline is the release of the next batch
+    next += period;
+    if (done > next) {
+        missed++;
+    }
+}
+
+void Pacer::Report(std::ostream &out) const {
+    out << "pace: batches " << batches << ", missed deadlines " << missed << std::endl;
+    jitter.Print(out, "pace: release jitter");
+    latency.Print(out, "pace: processing latency");
+}
+
+CpuLoad::CpuLoad(int threads, int percent) {
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back([this, percent] {
+            const auto slice = std::chrono::milliseconds(1);
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto start = Clock::now();
+                auto busy_until = start + slice * percent / 100;
+                while (Clock::now() < busy_until) {
+                }
+                std::this_thread::sleep_until(start + slice);
+            }
+        });
+    }
+}
+
+CpuLoad::~CpuLoad() {
+    stop = true;
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <thread>
+#include <vector>
+
+/*
+ * Support for replaying samples at their real (or an accelerated) rate
+ * instead of as fast as possible, to check that processing keeps up with the
+ * sample period.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+// Histogram with power-of-two nanosecond buckets.
+class LatencyHistogram {
+public:
+    void Add(Clock::duration d);
+    void Print(std::ostream &out, const char *label) const;
+
+private:
+    static constexpr int buckets = 40;
+    std::array<uint64_t, buckets> counts {};
+    uint64_t n = 0;
+    Clock::duration total {};
+    Clock::duration max {};
+};
+
+// Releases batches on a fixed schedule and measures how well processing keeps
+// up with it.
+class Pacer {
+public:
+    // <period> is the time between batches after applying any speedup.
+    explicit Pacer(Clock::duration period);
+
+    // Sleep until the next batch is due.
+    void WaitRelease();
+
+    // Mark the current batch as processed.
+    void Done();
+
+    void Report(std::ostream &out) const;
+
+private:
+    Clock::duration period;
+    Clock::time_point next;
+    Clock::time_point released;
+    bool started = false;
+
+    LatencyHistogram jitter;
+    LatencyHistogram latency;
+    uint64_t batches = 0;
+    uint64_t missed = 0;
+};
+
+// Synthetic CPU contention: <threads> threads that spin for <percent> of each
+// millisecond and sleep for the rest.
+class CpuLoad {
+public:
+    CpuLoad(int threads, int percent);
+    ~CpuLoad();
+
+private:
+    std::atomic<bool> stop {false};
+    std::vector<std::thread> workers;
+};
@@ -0,0 +1,139 @@
+#include "Pyramid.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    constexpr size_t name_size = 16;
+
+    struct Level {
+        std::FILE *file;
+        uint64_t count;
+    };
+
+    // Combine pairs of entries of <in> into a new temporary file.
+    Level Decimate(const Level &in, size_t channels) {
+        size_t floats = channels * 3;
+        std::vector<float> a(floats), b(floats);
+        Level out {std::tmpfile(), 0};
+        if (!out.file) {
+            return out;
+        }
+
+        std::rewind(in.file);
+        for (uint64_t i = 0; i < in.count; i += 2) {
+            std::fread(a.data(), sizeof(float), floats, in.file);
+            if (i + 1 < in.count) {
+                std::fread(b.data(), sizeof(float), floats, in.file);
+                for (size_t c = 0; c < channels; c++) {
+                    float *ea = &a[3 * c], *eb = &b[3 * c];
+                    ea[0] = std::min(ea[0], eb[0]);
+                    ea[1] = std::max(ea[1], eb[1]);
+                    // a trailing odd entry may cover fewer samples, ignore that here
+                    ea[2] = (ea[2] + eb[2]) / 2;
+                }
+            }
+            std::fwrite(a.data(), sizeof(float), floats, out.file);
+            out.count++;
+        }
+        return out;
+    }
+}
+
+PyramidWriter::PyramidWriter(const std::string &path, const std::vector<std::string> &channels, double dt)
+    : path(path), channels(channels), dt(dt), level0(std::tmpfile()), entry(3 * channels.size()) {}
+
+PyramidWriter::~PyramidWriter() {
+    if (level0) {
+        std::fclose(level0);
+    }
+}
+
+void PyramidWriter::Add(double t, const float *values) {
+    if (samples == 0) {
+        t0 = t;
+    }
+    for (size_t c = 0; c < channels.size(); c++) {
+        entry[3 * c] = entry[3 * c + 1] = entry[3 * c + 2] = values[c];
+    }
+    if (level0) {
+        std::fwrite(entry.data(), sizeof(float), entry.size(), level0);
+    }
+    samples++;
+}
+
+bool PyramidWriter::Finish() {
+    if (!level0) {
+        std::cerr << "Unable to create temporary file for '" << path << "'" << std::endl;
+        return false;
+    }
+
+    std::vector<Level> levels {{level0, samples}};
+    level0 = nullptr;
+    while (levels.back().count > 1) {
+        Level next = Decimate(levels.back(), channels.size());
+        if (!next.file) {
+            break;
+        }
+        levels.push_back(next);
+    }
+
+    std::FILE *out = std::fopen(path.c_str(), "wb");
+    bool ok = out != nullptr;
+    if (ok) {
+        uint32_t nchannels = channels.size(), nlevels = levels.size();
+        std::fwrite("TRACEPYR", 1, 8, out);
+        std::fwrite(&nchannels, sizeof(nchannels), 1, out);
+        std::fwrite(&nlevels, sizeof(nlevels), 1, out);
+        std::fwrite(&t0, sizeof(t0), 1, out);
+        std::fwrite(&dt, sizeof(dt), 1, out);
+        std::fwrite(&samples, sizeof(samples), 1, out);
+        for (const std::string &name : channels) {
+            char padded[name_size] = {};
+            strncpy(padded, name.c_str(), name_size - 1);
+            std::fwrite(padded, 1, name_size, out);
+        }
+
+        uint64_t offset = 8 + 4 + 4 + 8 + 8 + 8 + name_size * channels.size() + 16 * levels.size();
+        offset = (offset + 7) / 8 * 8;
+        uint64_t data_start = offset;
+        for (const Level &level : levels) {
+            std::fwrite(&offset, sizeof(offset), 1, out);
+            offset += level.count * channels.size() * 3 * sizeof(float);
+            offset = (offset + 7) / 8 * 8;
+        }
+        for (const Level &level : levels) {
+            std::fwrite(&level.count, sizeof(level.count), 1, out);
+        }
+
+        // copy the level data, padding each level to 8 bytes
+        std::vector<char> buf(1 << 16);
+        uint64_t pos = std::ftell(out);
+        std::vector<char> pad(8, 0);
+        std::fwrite(pad.data(), 1, data_start - pos, out);
+        for (const Level &level : levels) {
+            std::rewind(level.file);
+            uint64_t bytes = level.count * channels.size() * 3 * sizeof(float);
+            for (uint64_t done = 0; done < bytes;) {
+                size_t n = std::fread(buf.data(), 1, std::min<uint64_t>(buf.size(), bytes - done), level.file);
+                if (n == 0) {
+                    ok = false;
+                    break;
+                }
+                std::fwrite(buf.data(), 1, n, out);
+                done += n;
+            }
+            std::fwrite(pad.data(), 1, (8 - bytes % 8) % 8, out);
+        }
+        ok = std::fclose(out) == 0 && ok;
+    }
+    for (const Level &level : levels) {
+        std::fclose(level.file);
+    }
+
+    if (!ok) {
+        std::cerr << "Unable to write '" << path << "'" << std::endl;
+    }
+    return ok;
+}
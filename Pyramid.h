@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * Writes a multi-resolution trace of per-sample channels for zoomable
+ * viewing (trace_viewer.py). Level 0 holds every sample, level k each
+ * 2^k-sample block, with min, max and mean per channel, so a viewer can
+ * read only the level and range it needs for the current zoom.
+ *
+ * File layout, all little-endian and 8-byte aligned:
+ *
+ *   char     magic[8]              "TRACEPYR"
+ *   uint32   channels
+ *   uint32   levels
+ *   float64  t0                    time of the first sample
+ *   float64  dt                    sample period
+ *   uint64   samples
+ *   char     names[channels][16]   NUL-padded channel names
+ *   uint64   offset[levels]        file offset of each level
+ *   uint64   count[levels]         entries in each level
+ *   ...      level data            float32 [count][channels][3] (min, max, mean)
+ *
+ * Samples are assumed to be uniformly spaced.
+ */
+class PyramidWriter {
+public:
+    PyramidWriter(const std::string &path, const std::vector<std::string> &channels, double dt);
+    ~PyramidWriter();
+
+    PyramidWriter(const PyramidWriter &) = delete;
+    PyramidWriter &operator=(const PyramidWriter &) = delete;
+
+    // <values> holds one value per channel.
+    void Add(double t, const float *values);
+
+    // Build the coarser levels and write the file. Returns false and prints
+    // an error on failure.
+    bool Finish();
+
+private:
+    std::string path;
+    std::vector<std::string> channels;
+    double dt;
+    double t0 = 0;
+    uint64_t samples = 0;
+
+    std::FILE *level0;  // temporary file with the level 0 entries
+    std::vector<float> entry;
+};
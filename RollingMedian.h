@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+/*
+ * Median of the last <size> values. The window is kept both in arrival
+ * order (a ring buffer) and sorted; each update replaces the oldest value in
+ * the sorted copy with a binary search and one move of the values in
+ * between, which for windows of a few hundred values beats heap-based
+ * schemes.
+ */
+class RollingMedian {
+public:
+    explicit RollingMedian(size_t size) : ring(size) { sorted.reserve(size); }
+
+    void Add(float x) {
+        if (sorted.size() == ring.size()) {
+            float old = ring[pos];
+            auto from = std::lower_bound(sorted.begin(), sorted.end(), old);
+            auto to = std::upper_bound(sorted.begin(), sorted.end(), x);
+            // shift the values between the old and new position by one
+            if (to > from) {
+                std::move(from + 1, to, from);
+                *(to - 1) = x;
+            } else {
+                std::move_backward(to, from, from + 1);
+                *to = x;
+            }
+        } else {
+            sorted.insert(std::upper_bound(sorted.begin(), sorted.end(), x), x);
+        }
+        ring[pos] = x;
+        pos = (pos + 1) % ring.size();
+    }
+
+    bool Full() const { return sorted.size() == ring.size(); }
+
+    float Median() const {
+        size_t n = sorted.size();
+        if (n == 0) {
+            return 0;
+        }
+        return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    }
+
+private:
+    std::vector<float> ring;
+    std::vector<float> sorted;
+    size_t pos = 0;
+};
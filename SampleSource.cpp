@@ -0,0 +1,443 @@
+#include "SampleSource.h"
+#include "CwaReader.h"
+#include "FileDescriptor.h"
+#include "GeneActivReader.h"
+#include "LoserTree.h"
+#include "MemoryProfile.h"
+#include "TextSchema.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    constexpr size_t batch_samples = 256;
+    constexpr size_t read_size = 64 * 1024;
+
+    SampleBatches ReadText(FileDescriptor file, TextSchema schema) {
+        RowParser parser(schema);
+        int preamble = schema.skip + (schema.header ? 1 : 0);  // rows before the data
+        std::vector<char> buf;
+        std::vector<Sample> batch;
+        {
+            MemoryStageScope stage(InputStage);
+            buf.resize(read_size + 1);
+            batch.reserve(batch_samples);
+        }
+        size_t len = 0;
+        bool eof = false;
+
+        while (!eof) {
+            TraceSpan reading("read");
+            ssize_t n = read(file.fd, buf.data() + len, buf.size() - 1 - len);
+            reading.End();
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                eof = true;
+            } else {
+                len += n;
+            }
+
+            // parse all complete lines, and the trailing partial line at end of file
+            TraceSpan parsing("parse");
+            char *p = buf.data();
+            char *end = p + len;
+            *end = '\0';
+            while (p < end) {
+                char *nl = static_cast<char *>(memchr(p, '\n', end - p));
+                if (!nl && !eof) {
+                    break;
+                }
+                char *line_end = nl ? nl : end;
+                *line_end = '\0';
+
+                Sample s;
+                if (preamble > 0) {
+                    if (--preamble == 0 && schema.header) {
+                        parser.Header(p, line_end);
+                    }
+                } else if (parser.Parse(p, line_end, s)) {
+                    batch.push_back(s);
+                    if (batch.size() == batch_samples) {
+                        parsing.End();
+                        co_yield std::span<const Sample>(batch);
+                        parsing.Begin();
+                        batch.clear();
+                    }
+                }
+                p = line_end + 1;
+            }
+
+            // keep the partial line for the next read, growing the buffer for very long lines
+            len = p < end ? end - p : 0;
+            memmove(buf.data(), p, len);
+            if (len == buf.size() - 1) {
+                MemoryStageScope stage(InputStage);
+                buf.resize(buf.size() * 2);
+            }
+        }
+
+        if (!batch.empty()) {
+            co_yield std::span<const Sample>(batch);
+        }
+    }
+
+    SampleBatches ReadBinary(FileDescriptor file) {
+        std::vector<Sample> batch;
+        {
+            MemoryStageScope stage(InputStage);
+            batch.resize(batch_samples);
+        }
+        size_t have = 0;  // bytes
+
+        while (true) {
+            char *dst = reinterpret_cast<char *>(batch.data());
+            TraceSpan reading("read");
+            ssize_t n = read(file.fd, dst + have, batch.size() * sizeof(Sample) - have);
+            reading.End();
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            have += n;
+
+            size_t complete = have / sizeof(Sample);
+            if (complete == batch.size()) {
+                co_yield std::span<const Sample>(batch);
+                have = 0;
+            }
+        }
+
+        if (have / sizeof(Sample) > 0) {
+            co_yield std::span<const Sample>(batch.data(), have / sizeof(Sample));
+        }
+    }
+}
+
+SampleBatches TextSamples(int fd, TextSchema schema) {
+    return ReadText(FileDescriptor(fd), std::move(schema));
+}
+
+SampleBatches BinarySamples(int fd) {
+    return ReadBinary(FileDescriptor(fd));
+}
+
+SampleBatches SyntheticSamples(double seconds, float fs, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0, 1);
+    std::vector<Sample> batch(batch_samples);
+
+    const double period = 1800;  // seconds between restless and still
+    uint64_t total = uint64_t(seconds * fs);
+    for (uint64_t i = 0; i < total;) {
+        size_t n = std::min<uint64_t>(batch.size(), total - i);
+        for (size_t j = 0; j < n; j++, i++) {
+            Sample &s = batch[j];
+            s.t = i / double(fs);
+            bool still = (uint64_t(s.t / period) % 2) == 1;
+            float sd = still ? 0.01f : 0.3f;
+            s.x = sd * noise(rng);
+            s.y = sd * noise(rng);
+            s.z = -1 + sd * noise(rng);
+            s.truth = still;
+        }
+        co_yield std::span<const Sample>(batch.data(), n);
+    }
+}
+
+SampleBatches Resample(SampleBatches source, float fs) {
+    std::vector<Sample> batch;
+    {
+        MemoryStageScope stage(InputStage);
+        batch.reserve(batch_samples);
+    }
+
+    bool have_prev = false;
+    Sample prev {};
+    uint64_t k = 0;
+    double t0 = 0;
+
+    for (auto in : source) {
+        for (const Sample &s : in) {
+            if (!have_prev) {
+                prev = s;
+                t0 = s.t;
+                have_prev = true;
+                continue;
+            }
+            if (s.t <= prev.t) {
+                continue;  // not sorted; drop
+            }
+
+            // emit every grid point in [prev.t, s.t)
+            double ti;
+            while ((ti = t0 + k / double(fs)) < s.t) {
+                float a = float((ti - prev.t) / (s.t - prev.t));
+                batch.push_back({ti,
+                                 prev.x + a * (s.x - prev.x),
+                                 prev.y + a * (s.y - prev.y),
+                                 prev.z + a * (s.z - prev.z),
+                                 prev.truth});
+                k++;
+                if (batch.size() == batch_samples) {
+                    co_yield std::span<const Sample>(batch);
+                    batch.clear();
+                }
+            }
+            prev = s;
+        }
+    }
+
+    if (!batch.empty()) {
+        co_yield std::span<const Sample>(batch);
+    }
+}
+
+SampleBatches TimeSlice(SampleBatches source, double from, double to) {
+    for (auto in : source) {
+        auto first = std::find_if(in.begin(), in.end(), [from](const Sample &s) { return s.t >= from; });
+        auto last = std::find_if(first, in.end(), [to](const Sample &s) { return s.t >= to; });
+        if (first != last) {
+            co_yield std::span<const Sample>(first, last);
+        }
+        if (last != in.end()) {
+            break;  // input is sorted, nothing more to come
+        }
+    }
+}
+
+SampleBatches Merge(std::vector<SampleBatches> sources, MergePolicy policy, MergeStats *stats) {
+    MergeStats local_stats;
+    if (!stats) {
+        stats = &local_stats;
+    }
+
+    struct Cursor {
+        std::span<const Sample> batch;
+        size_t pos = 0;
+        bool done = false;
+    };
+    std::vector<Cursor> cursors(sources.size());
+    auto fetch = [&](size_t i) {
+        Cursor &c = cursors[i];
+        while (c.pos >= c.batch.size()) {
+            if (!sources[i].Next()) {
+                c.done = true;
+                return;
+            }
+            c.batch = sources[i].Value();
+            c.pos = 0;
+        }
+    };
+    for (size_t i = 0; i < sources.size(); i++) {
+        fetch(i);
+    }
+
+    auto less = [&cursors](size_t a, size_t b) {
+        const Cursor &ca = cursors[a];
+        const Cursor &cb = cursors[b];
+        if (ca.done || cb.done) {
+            return !ca.done && cb.done ? true : ca.done == cb.done && a < b;
+        }
+        double ta = ca.batch[ca.pos].t;
+        double tb = cb.batch[cb.pos].t;
+        return ta < tb || (ta == tb && a < b);
+    };
+    LoserTree<decltype(less)> tree(sources.size(), less);
+
+    std::vector<Sample> batch;
+    {
+        MemoryStageScope stage(MergeStage);
+        batch.reserve(batch_samples);
+    }
+    const double period = 1 / double(policy.fs);
+    bool have_last = false;
+    Sample last {};
+
+    while (!sources.empty() && !cursors[tree.Winner()].done) {
+        size_t i = tree.Winner();
+        const Sample s = cursors[i].batch[cursors[i].pos];
+        cursors[i].pos++;
+        fetch(i);
+        tree.Replay();
+
+        if (have_last && s.t < last.t + policy.dedup) {
+            stats->duplicates++;
+            continue;
+        }
+
+        if (have_last && s.t - last.t > 1.5 * period) {
+            double gap = s.t - last.t;
+            stats->gaps++;
+            stats->gap_seconds += gap;
+
+            if (policy.fill != MergePolicy::Fill::None && gap <= policy.max_fill) {
+                for (double ti = last.t + period; ti < s.t - period / 2; ti += period) {
+                    Sample f = last;
+                    f.t = ti;
+                    if (policy.fill == MergePolicy::Fill::Linear) {
+                        float a = float((ti - last.t) / gap);
+                        f.x = last.x + a * (s.x - last.x);
+                        f.y = last.y + a * (s.y - last.y);
+                        f.z = last.z + a * (s.z - last.z);
+                    }
+                    batch.push_back(f);
+                    stats->filled++;
+                    stats->samples++;
+                    if (batch.size() == batch_samples) {
+                        co_yield std::span<const Sample>(batch);
+                        batch.clear();
+                    }
+                }
+            }
+        }
+
+        batch.push_back(s);
+        stats->samples++;
+        last = s;
+        have_last = true;
+        if (batch.size() == batch_samples) {
+            co_yield std::span<const Sample>(batch);
+            batch.clear();
+        }
+    }
+
+    if (!batch.empty()) {
+        co_yield std::span<const Sample>(batch);
+    }
+}
+
+namespace {
+    int ConnectUnix(const std::string &path) {
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        strcpy(addr.sun_path, path.c_str());
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    int ConnectTcp(const std::string &hostport) {
+        size_t colon = hostport.rfind(':');
+        if (colon == std::string::npos) {
+            errno = EINVAL;
+            return -1;
+        }
+        std::string host = hostport.substr(0, colon);
+        std::string port = hostport.substr(colon + 1);
+
+        addrinfo hints {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *res;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) {
+            errno = EHOSTUNREACH;
+            return -1;
+        }
+
+        int fd = -1;
+        for (addrinfo *ai = res; ai; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+                break;
+            }
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(res);
+        return fd;
+    }
+}
+
+void SplitSourceSpec(const std::string &spec, std::string &type, std::string &location) {
+    static const char *const types[] = {"text", "raw", "bin", "cwa", "geneactiv", "synth", "unix", "tcp"};
+    type = "text";
+    location = spec;
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos) {
+        return;
+    }
+    for (const char *known : types) {
+        if (spec.compare(0, colon, known) == 0) {
+            type = known;
+            location = spec.substr(colon + 1);
+            return;
+        }
+    }
+}
+
+bool OpenSource(const std::string &spec, SampleBatches &source, const TextSchema &schema) {
+    std::string type, location;
+    SplitSourceSpec(spec, type, location);
+
+    if (type == "synth") {
+        char *end;
+        double seconds = strtod(location.c_str(), &end);
+        if (*end != '\0' || seconds <= 0) {
+            std::cerr << "Invalid synthetic duration '" << location << "'" << std::endl;
+            return false;
+        }
+        source = SyntheticSamples(seconds, 10);
+        return true;
+    }
+
+    int fd;
+    if (type == "unix") {
+        fd = ConnectUnix(location);
+    } else if (type == "tcp") {
+        fd = ConnectTcp(location);
+    } else {
+        fd = location == "-" ? dup(STDIN_FILENO) : open(location.c_str(), O_RDONLY);
+    }
+    if (fd < 0) {
+        std::cerr << "Unable to open '" << spec << "': " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (type == "bin") {
+        source = BinarySamples(fd);
+    } else if (type == "cwa") {
+        source = Resample(CwaSamples(fd, std::thread::hardware_concurrency()), 10);
+    } else if (type == "geneactiv") {
+        source = Resample(GeneActivSamples(fd, std::thread::hardware_concurrency()), 10);
+    } else if (type == "raw") {
+        TextSchema raw = schema;
+        if (raw.IsNative()) {
+            raw.columns[TextSchema::Truth].index = -1;
+        }
+        source = Resample(TextSamples(fd, raw), 10);
+    } else {
+        source = TextSamples(fd, schema);
+    }
+    return true;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Generator.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+ * Lazy sample sources and adapters. Every source is a generator of sample
+ * batches; a batch is only valid until the generator is resumed, so
+ * consumers process it in place instead of copying it out. Adapters take
+ * their input generator by value and can be chained freely, e.g.
+ *
+ *   for (auto batch : TimeSlice(Resample(TextSamples(fd, schema), 10), 0, 3600))
+ *       ...
+ */
+
+struct Sample {
+    double t;  // seconds
+    float x, y, z;  // g
+    float truth;
+};
+
+using SampleBatches = Generator<std::span<const Sample>>;
+
+struct TextSchema;
+
+// Delimited text rows read from a file descriptor (file, pipe or socket),
+// by default whitespace-delimited "TIME X Y Z TRUTH". Fields the schema does
+// not read are set to 0. Throws std::runtime_error if the header does not
+// match the schema. Closes <fd> when done.
+SampleBatches TextSamples(int fd, TextSchema schema);
+
+// Native binary format: a sequence of Sample structs in host byte order.
+// Closes <fd> when done.
+SampleBatches BinarySamples(int fd);
+
+// Uniform-rate synthetic data alternating between restless and still
+// periods, for <seconds> seconds at <fs> Hz. Truth is 1 for still periods.
+SampleBatches SyntheticSamples(double seconds, float fs, unsigned seed = 0);
+
+// Linear interpolation of irregularly spaced samples onto a uniform <fs> Hz
+// time axis, with zero-order hold of truth, as done by stimuli() in
+// vanhees2015.py.
+SampleBatches Resample(SampleBatches source, float fs);
+
+// Only samples with <from> <= t < <to>.
+SampleBatches TimeSlice(SampleBatches source, double from, double to);
+
+struct MergePolicy {
+    enum class Fill {
+        None,  // pass gaps through
+        Hold,  // repeat the last sample
+        Linear,  // interpolate between the samples around the gap
+    };
+
+    float fs = 10;  // Hz, nominal rate of the merged stream
+    double dedup = 0.05;  // drop samples less than this many seconds after the previous one
+    Fill fill = Fill::None;
+    double max_fill = 60;  // seconds, longer gaps are left unfilled
+};
+
+struct MergeStats {
+    uint64_t samples = 0;  // output samples, including filled ones
+    uint64_t duplicates = 0;
+    uint64_t gaps = 0;  // gaps longer than 1.5 sample periods
+    uint64_t filled = 0;
+    double gap_seconds = 0;
+};
+
+// Merge timestamp-sorted sources into one timestamp-sorted stream using a
+// loser tree, in O(log N) per sample and O(N) memory for N sources.
+// Overlapping samples are dropped and gaps filled according to <policy>.
+// If <stats> is given it is updated as the stream is consumed.
+SampleBatches Merge(std::vector<SampleBatches> sources, MergePolicy policy = {},
+                    MergeStats *stats = nullptr);
+
+// Open a source from a spec of the form [TYPE:]LOCATION, where TYPE is
+//   text   rows in the format given by <schema> (default), "-" for stdin
+//   raw    rows at any rate, resampled to 10 Hz; with the native schema,
+//          TIME X Y Z without TRUTH
+//   bin    native binary format
+//   cwa    Axivity .cwa file, resampled to 10 Hz
+//   geneactiv  GENEActiv .bin file, resampled to 10 Hz
+//   synth  synthetic data, LOCATION is the duration in seconds
+//   unix   text rows from a Unix domain socket at path LOCATION
+//   tcp    text rows from a TCP connection to HOST:PORT
+// Prints an error and returns false if the source could not be opened.
+bool OpenSource(const std::string &spec, SampleBatches &source, const TextSchema &schema);
+
+// Split a source spec into TYPE and LOCATION as OpenSource does. A prefix
+// that is not a known TYPE is part of a plain text file path.
+void SplitSourceSpec(const std::string &spec, std::string &type, std::string &location);
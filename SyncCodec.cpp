@@ -0,0 +1,171 @@
+#include "SyncCodec.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    enum FrameKind : uint8_t {
+        TransitionFrame = 1,
+        WindowFrame = 2,
+    };
+
+    constexpr uint8_t max_code = 0xbf;
+    constexpr uint8_t first_run = 0xc0;  // repeat once
+    constexpr int max_run = 64;
+
+    size_t VarintSize(uint64_t v) {
+        size_t n = 1;
+        while (v >= 0x80) {
+            v >>= 7;
+            n++;
+        }
+        return n;
+    }
+
+    void PutVarint(std::vector<uint8_t> &out, uint64_t v) {
+        while (v >= 0x80) {
+            out.push_back(uint8_t(v) | 0x80);
+            v >>= 7;
+        }
+        out.push_back(uint8_t(v));
+    }
+
+    bool GetVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v) {
+        v = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7) {
+            uint8_t b = *p++;
+            v |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint64_t ZigZag(int64_t v) {
+        return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+    }
+
+    int64_t UnZigZag(uint64_t v) {
+        return int64_t(v >> 1) ^ -int64_t(v & 1);
+    }
+}
+
+SyncEncoder::SyncEncoder(const SyncConfig &config, Emit emit) : config(config), emit(std::move(emit)) {}
+
+int64_t SyncEncoder::Units(double t) const {
+    return std::llround(t / config.time_step);
+}
+
+void SyncEncoder::Flush(std::vector<uint8_t> &frame) {
+    if (!frame.empty()) {
+        emit(frame);
+        frame.clear();
+    }
+}
+
+void SyncEncoder::AddTransition(double t, uint8_t state) {
+    int64_t time = Units(t);
+    // deltas are unsigned, a step back in time starts a frame from an
+    // absolute time instead
+    if (!transitions.empty() && time < last_time) {
+        Flush(transitions);
+    }
+    uint64_t item = uint64_t(time - last_time) << 1 | (state & 1);
+    if (!transitions.empty() && transitions.size() + VarintSize(item) > config.mtu) {
+        Flush(transitions);
+    }
+    if (transitions.empty()) {
+        transitions.push_back(TransitionFrame);
+        PutVarint(transitions, ZigZag(time));
+        item = state & 1;
+    }
+    PutVarint(transitions, item);
+    last_time = time;
+}
+
+void SyncEncoder::AddWindow(double t, float change) {
+    if (!config.windows) {
+        return;
+    }
+    uint8_t code = uint8_t(std::clamp(std::lround(change / config.change_step), 0L, long(max_code)));
+
+    // a gap in the windows, or a full frame, starts a new one
+    double expected = window_t0 + window_count * config.window_seconds;
+    if (!windows.empty() && (std::abs(t - expected) > config.window_seconds / 2 || windows.size() + 1 > config.mtu)) {
+        Flush(windows);
+    }
+    if (windows.empty()) {
+        windows.push_back(WindowFrame);
+        window_t0 = double(Units(t)) * config.time_step;
+        PutVarint(windows, ZigZag(Units(t)));
+        window_count = 0;
+    } else if (code == last_code) {
+        uint8_t &last = windows.back();
+        if (last >= first_run && last < first_run + max_run - 1) {
+            last++;
+        } else {
+            windows.push_back(first_run);
+        }
+        window_count++;
+        return;
+    }
+    windows.push_back(code);
+    last_code = code;
+    window_count++;
+}
+
+void SyncEncoder::Finish() {
+    Flush(transitions);
+    Flush(windows);
+}
+
+SyncDecoder::SyncDecoder(const SyncConfig &config, Transition transition, Window window)
+    : config(config), transition(std::move(transition)), window(std::move(window)) {}
+
+bool SyncDecoder::Decode(std::span<const uint8_t> frame) {
+    const uint8_t *p = frame.data(), *end = p + frame.size();
+    uint64_t v;
+    if (p == end) {
+        return false;
+    }
+    uint8_t kind = *p++;
+    if (!GetVarint(p, end, v)) {
+        return false;
+    }
+    int64_t time = UnZigZag(v);
+
+    if (kind == TransitionFrame) {
+        while (p < end) {
+            if (!GetVarint(p, end, v)) {
+                return false;
+            }
+            time += int64_t(v >> 1);
+            transition(time * config.time_step, uint8_t(v & 1));
+        }
+        return true;
+    }
+    if (kind == WindowFrame) {
+        double t = time * config.time_step;
+        float change = 0;
+        bool have_change = false;
+        for (; p < end; p++) {
+            int repeat = 1;
+            if (*p >= first_run) {
+                if (!have_change) {
+                    return false;
+                }
+                repeat = *p - first_run + 1;
+            } else {
+                change = *p * config.change_step;
+                have_change = true;
+            }
+            for (int i = 0; i < repeat; i++) {
+                window(t, change);
+                t += config.window_seconds;
+            }
+        }
+        return true;
+    }
+    return false;
+}
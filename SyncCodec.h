@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+/*
+ * Compact encoding of tracker output for BLE sync. Transitions and optional
+ * per-window arm angle changes go into separate frames of at most <mtu>
+ * bytes, one per notification. Every frame starts from an absolute time, so
+ * frames decode on their own and a lost frame loses only its own items.
+ *
+ * Transition frame:
+ *
+ *   uint8   kind          1
+ *   varint  t0            zigzag, in <time_step> units
+ *   varint  item[]        (time - previous time) << 1 | state, the first
+ *                         relative to t0
+ *
+ * Window frame, for windows <window_seconds> apart from t0 on:
+ *
+ *   uint8   kind          2
+ *   varint  t0
+ *   uint8   token[]       0x00..0xbf: change in <change_step> units,
+ *                         saturated; 0xc0..0xff: previous change repeated
+ *                         1..64 more times
+ *
+ * Varints are LEB128, 7 bits per byte, low bits first. States are 0 or 1.
+ * Times that go backwards start a new frame rather than being clamped.
+ */
+struct SyncConfig {
+    size_t mtu = 244;  // ATT payload with a 247 byte MTU
+    double time_step = 1;  // seconds
+    bool windows = false;  // send window changes
+    float change_step = 0.25f;  // degrees
+    double window_seconds = 5;
+};
+
+class SyncEncoder {
+public:
+    using Emit = std::function<void(std::span<const uint8_t> frame)>;
+
+    SyncEncoder(const SyncConfig &config, Emit emit);
+
+    void AddTransition(double t, uint8_t state);
+    // Ignored unless config.windows is set.
+    void AddWindow(double t, float change);
+
+    // Emit the frames that are not full yet.
+    void Finish();
+
+private:
+    void Flush(std::vector<uint8_t> &frame);
+    int64_t Units(double t) const;
+
+    SyncConfig config;
+    Emit emit;
+
+    std::vector<uint8_t> transitions;
+    int64_t last_time = 0;
+
+    std::vector<uint8_t> windows;
+    double window_t0 = 0;
+    uint64_t window_count = 0;
+    uint8_t last_code = 0;
+};
+
+class SyncDecoder {
+public:
+    using Transition = std::function<void(double t, uint8_t state)>;
+    using Window = std::function<void(double t, float change)>;
+
+    SyncDecoder(const SyncConfig &config, Transition transition, Window window);
+
+    // Returns false if <frame> is malformed; items before the error are
+    // still reported.
+    bool Decode(std::span<const uint8_t> frame);
+
+private:
+    SyncConfig config;
+    Transition transition;
+    Window window;
+};
@@ -0,0 +1,278 @@
+#include "TextSchema.h"
+
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+    const char *field_names[TextSchema::Fields] = {"time", "x", "y", "z", "truth"};
+
+    // Find the end of the field starting at <p>, after skipping leading
+    // whitespace when fields are whitespace-delimited.
+    const char *FieldEnd(const char *&p, const char *end, char delimiter) {
+        if (delimiter == 0) {
+            while (p < end && isspace((unsigned char)*p)) {
+                p++;
+            }
+            const char *q = p;
+            while (q < end && !isspace((unsigned char)*q)) {
+                q++;
+            }
+            return q;
+        }
+        const char *q = static_cast<const char *>(memchr(p, delimiter, end - p));
+        return q ? q : end;
+    }
+
+    // Strip whitespace and quotes around a field.
+    void Trim(const char *&p, const char *&q) {
+        while (p < q && (isspace((unsigned char)*p) || *p == '"')) {
+            p++;
+        }
+        while (q > p && (isspace((unsigned char)q[-1]) || q[-1] == '"')) {
+            q--;
+        }
+    }
+
+    // Parse a row the fast way for the native format. <columns> is 4 or 5.
+    bool ParseNative(const char *p, const char *end, int columns, Sample &s) {
+        char *next;
+        float values[4] = {};
+
+        s.t = strtod(p, &next);
+        if (next == p || next > end) {
+            return false;
+        }
+        for (int i = 0; i < columns - 1; i++) {
+            p = next;
+            values[i] = strtof(p, &next);
+            if (next == p || next > end) {
+                return false;
+            }
+        }
+        s.x = values[0];
+        s.y = values[1];
+        s.z = values[2];
+        s.truth = values[3];
+        return true;
+    }
+}
+
+TextSchema TextSchema::Native(bool truth) {
+    TextSchema schema;
+    if (!truth) {
+        schema.columns[Truth].index = -1;
+    }
+    return schema;
+}
+
+bool TextSchema::IsNative() const {
+    if (delimiter != 0 || skip != 0 || header) {
+        return false;
+    }
+    for (int field = 0; field < Fields; field++) {
+        const Column &c = columns[field];
+        bool unused_truth = field == Truth && c.index == -1;
+        if (!unused_truth && (c.index != field || !c.name.empty() || c.scale != 1 || c.offset != 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TextSchema::Load(const std::string &path) {
+    std::ifstream infile(path);
+    if (!infile.is_open()) {
+        std::cerr << "Unable to open schema '" << path << "'" << std::endl;
+        return false;
+    }
+
+    TextSchema loaded = *this;
+    std::string line;
+    int lineno = 0;
+    while (std::getline(infile, line)) {
+        lineno++;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        std::string key, value;
+        if (!(fields >> key)) {
+            continue;
+        }
+        fields >> value;
+
+        if (key == "delimiter") {
+            if (value.empty() || value == "space" || value == "whitespace") {
+                loaded.delimiter = 0;
+            } else if (value == "tab") {
+                loaded.delimiter = '\t';
+            } else if (value.size() == 1) {
+                loaded.delimiter = value[0];
+            } else {
+                std::cerr << path << ":" << lineno << ": invalid delimiter '" << value << "'" << std::endl;
+                return false;
+            }
+            continue;
+        }
+        if (key == "skip") {
+            loaded.skip = atoi(value.c_str());
+            continue;
+        }
+        if (key == "header") {
+            loaded.header = value.empty() || value == "1" || value == "yes";
+            continue;
+        }
+
+        int field = 0;
+        while (field < Fields && key != field_names[field]) {
+            field++;
+        }
+        if (field == Fields || value.empty()) {
+            std::cerr << path << ":" << lineno << ": invalid setting '" << line << "'" << std::endl;
+            return false;
+        }
+
+        Column c;
+        if (value == "none") {
+            c.index = -1;
+        } else {
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), c.index);
+            if (ec != std::errc() || end != value.data() + value.size() || c.index < 0) {
+                c.index = -1;
+                c.name = value;
+            }
+            if (!(fields >> c.scale)) {
+                c.scale = 1;
+            } else if (!(fields >> c.offset)) {
+                c.offset = 0;
+            }
+        }
+        loaded.columns[field] = c;
+    }
+
+    if (!loaded.header) {
+        for (const Column &c : loaded.columns) {
+            if (!c.name.empty()) {
+                std::cerr << path << ": column '" << c.name << "' given by name, but there is no header" << std::endl;
+                return false;
+            }
+        }
+    }
+    for (int field = 0; field < Fields; field++) {
+        const Column &c = loaded.columns[field];
+        for (int other = 0; other < field; other++) {
+            const Column &o = loaded.columns[other];
+            if ((c.index >= 0 && c.index == o.index) || (!c.name.empty() && c.name == o.name)) {
+                std::cerr << path << ": " << field_names[other] << " and " << field_names[field]
+                          << " are read from the same column" << std::endl;
+                return false;
+            }
+        }
+    }
+    for (int field = Time; field <= Z; field++) {
+        if (loaded.columns[field].index < 0 && loaded.columns[field].name.empty()) {
+            std::cerr << path << ": no column for " << field_names[field] << std::endl;
+            return false;
+        }
+    }
+
+    *this = loaded;
+    return true;
+}
+
+RowParser::RowParser(const TextSchema &schema) : schema(schema), native(schema.IsNative()) {
+    Resolve();
+}
+
+void RowParser::Resolve() {
+    field_of_column.clear();
+    for (int field = 0; field < TextSchema::Fields; field++) {
+        int index = schema.columns[field].index;
+        if (index < 0) {
+            continue;
+        }
+        if ((size_t)index >= field_of_column.size()) {
+            field_of_column.resize(index + 1, -1);
+        }
+        if (field_of_column[index] >= 0) {
+            // only by a name in the header matching a column given by index
+            throw std::runtime_error(std::string(field_names[field_of_column[index]]) + " and "
+                                     + field_names[field] + " are read from the same column");
+        }
+        field_of_column[index] = field;
+    }
+}
+
+void RowParser::Header(const char *p, const char *end) {
+    std::vector<std::string> names;
+    while (p < end) {
+        const char *q = FieldEnd(p, end, schema.delimiter);
+        const char *name_begin = p, *name_end = q;
+        Trim(name_begin, name_end);
+        if (q > p || schema.delimiter != 0) {
+            names.emplace_back(name_begin, name_end);
+        }
+        p = q + 1;
+    }
+
+    for (int field = 0; field < TextSchema::Fields; field++) {
+        TextSchema::Column &c = schema.columns[field];
+        if (c.name.empty()) {
+            continue;
+        }
+        c.index = -1;
+        for (size_t i = 0; i < names.size(); i++) {
+            if (names[i] == c.name) {
+                c.index = i;
+                break;
+            }
+        }
+        if (c.index < 0) {
+            throw std::runtime_error("no column '" + c.name + "' in header");
+        }
+    }
+    Resolve();
+}
+
+bool RowParser::Parse(const char *p, const char *end, Sample &s) const {
+    if (native) {
+        return ParseNative(p, end, schema.columns[TextSchema::Truth].index < 0 ? 4 : 5, s);
+    }
+
+    double values[TextSchema::Fields] = {};
+    size_t last = field_of_column.size();
+    for (size_t i = 0; i < last; i++) {
+        if (p > end) {
+            return false;  // too few columns
+        }
+        const char *q = FieldEnd(p, end, schema.delimiter);
+
+        int field = field_of_column[i];
+        if (field >= 0) {
+            const char *v = p, *v_end = q;
+            Trim(v, v_end);
+            if (v < v_end && *v == '+') {
+                v++;
+            }
+            auto [parsed_end, ec] = std::from_chars(v, v_end, values[field]);
+            if (ec != std::errc() || parsed_end != v_end) {
+                return false;
+            }
+            const TextSchema::Column &c = schema.columns[field];
+            values[field] = values[field] * c.scale + c.offset;
+        }
+        p = q + 1;
+    }
+
+    s.t = values[TextSchema::Time];
+    s.x = values[TextSchema::X];
+    s.y = values[TextSchema::Y];
+    s.z = values[TextSchema::Z];
+    s.truth = values[TextSchema::Truth];
+    return true;
+}
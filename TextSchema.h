@@ -0,0 +1,75 @@
+#pragma once
+
+#include "SampleSource.h"
+
+#include <array>
+#include <string>
+#include <vector>
+
+/*
+ * Describes the layout of a delimited text input: the delimiter, rows to
+ * skip, an optional header row with column names, and which column (by
+ * index or name) holds each sample field, with a scale and offset to convert
+ * units. Columns that are not mapped to a field are skipped without being
+ * converted. Schema files hold one "KEY VALUE..." setting per line, e.g. for
+ * a CSV export with time in milliseconds and acceleration in m/s^2:
+ *
+ *   delimiter ,
+ *   header
+ *   time timestamp 0.001
+ *   x acc_x 0.101972
+ *   y acc_y 0.101972
+ *   z acc_z 0.101972
+ *   truth none
+ */
+struct TextSchema {
+    enum Field {
+        Time,
+        X,
+        Y,
+        Z,
+        Truth,
+        Fields,
+    };
+
+    struct Column {
+        int index = -1;  // -1 if the field is not read
+        std::string name;  // looked up in the header row if set
+        double scale = 1;
+        double offset = 0;
+    };
+
+    char delimiter = 0;  // 0 for runs of whitespace
+    int skip = 0;  // rows to skip before the header or data
+    bool header = false;
+    std::array<Column, Fields> columns {{{0, {}}, {1, {}}, {2, {}}, {3, {}}, {4, {}}}};
+
+    // The native TIME X Y Z TRUTH format, optionally without reading TRUTH.
+    static TextSchema Native(bool truth = true);
+
+    // Whether rows can be read with the fast path for the native format.
+    bool IsNative() const;
+
+    // Returns false and leaves the schema untouched on errors.
+    bool Load(const std::string &path);
+};
+
+// Parses rows according to a schema, once the header (if any) has been seen.
+class RowParser {
+public:
+    explicit RowParser(const TextSchema &schema);
+
+    // Resolve column names against the header row. Throws std::runtime_error
+    // if a column is missing.
+    void Header(const char *p, const char *end);
+
+    // Parse one row into <s>, returning false for blank or malformed rows.
+    bool Parse(const char *p, const char *end, Sample &s) const;
+
+private:
+    void Resolve();
+
+    TextSchema schema;
+    bool native;
+    std::vector<int> field_of_column;  // index into schema.columns, or -1
+};
@@ -0,0 +1,179 @@
+#include "Trace.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+
+#include <unistd.h>
+
+bool trace_enabled = false;
+
+namespace {
+    struct Record {
+        enum Type : uint8_t {
+            Span,
+            Counter,
+            ThreadName,
+        };
+
+        const char *name;
+        uint64_t begin;
+        union {
+            uint64_t end;
+            double value;
+        };
+        Type type;
+    };
+
+    constexpr size_t chunk_records = 4096;
+
+    struct Chunk {
+        Record records[chunk_records];
+        std::atomic<size_t> count {0};  // published with release, read at exit
+        Chunk *next = nullptr;
+    };
+
+    // Never freed, so the trace can still be written after worker threads
+    // have exited. A buffer is owned by one thread at a time; when it exits
+    // the buffer goes on the free list for the next new thread, so short-lived
+    // threads (one per std::async decode chunk) share buffers and tids.
+    struct Buffer {
+        Chunk *head;
+        Chunk *tail;
+        Buffer *next;
+        Buffer *next_free;
+        int tid;
+    };
+
+    std::atomic<Buffer *> buffers {nullptr};
+    std::atomic<int> next_tid {1};
+    std::mutex free_lock;
+    Buffer *free_buffers = nullptr;
+    std::string trace_path;
+
+    uint64_t start_ticks;
+    std::chrono::steady_clock::time_point start_time;
+
+    // Returns the thread's buffer to the free list when the thread exits.
+    struct ThreadBuffer {
+        Buffer *buffer = nullptr;
+
+        ~ThreadBuffer() {
+            if (buffer) {
+                std::lock_guard<std::mutex> lock(free_lock);
+                buffer->next_free = free_buffers;
+                free_buffers = buffer;
+            }
+        }
+    };
+
+    Buffer *ThisThread() {
+        thread_local ThreadBuffer local;
+        if (!local.buffer) {
+            {
+                std::lock_guard<std::mutex> lock(free_lock);
+                if (free_buffers) {
+                    local.buffer = free_buffers;
+                    free_buffers = free_buffers->next_free;
+                }
+            }
+            if (!local.buffer) {
+                Chunk *chunk = new Chunk;
+                local.buffer = new Buffer {chunk, chunk, buffers.load(), nullptr, next_tid++};
+                while (!buffers.compare_exchange_weak(local.buffer->next, local.buffer)) {
+                }
+            }
+        }
+        return local.buffer;
+    }
+
+    void Append(const Record &r) {
+        Buffer *buffer = ThisThread();
+        Chunk *chunk = buffer->tail;
+        size_t n = chunk->count.load(std::memory_order_relaxed);
+        if (n == chunk_records) {
+            chunk->next = new Chunk;
+            chunk = buffer->tail = chunk->next;
+            n = 0;
+        }
+        chunk->records[n] = r;
+        chunk->count.store(n + 1, std::memory_order_release);
+    }
+
+    void WriteTrace() {
+        // convert ticks to microseconds with the rate measured over the run
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_time).count();
+        uint64_t ticks = TraceClock() - start_ticks;
+        double us_per_tick = ticks ? us / ticks : 0;
+
+        std::FILE *out = std::fopen(trace_path.c_str(), "w");
+        if (!out) {
+            std::cerr << "Unable to write '" << trace_path << "'" << std::endl;
+            return;
+        }
+        int pid = getpid();
+        const char *sep = "";
+        std::fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        for (Buffer *b = buffers.load(); b; b = b->next) {
+            for (Chunk *c = b->head; c; c = c->next) {
+                size_t n = c->count.load(std::memory_order_acquire);
+                for (size_t i = 0; i < n; i++) {
+                    const Record &r = c->records[i];
+                    double ts = (r.begin - start_ticks) * us_per_tick;
+                    switch (r.type) {
+                    case Record::Span:
+                        std::fprintf(out, "%s{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                                     "\"pid\": %d, \"tid\": %d}",
+                                     sep, r.name, ts, (r.end - r.begin) * us_per_tick, pid, b->tid);
+                        break;
+                    case Record::Counter:
+                        std::fprintf(out, "%s{\"name\": \"%s\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": %d, "
+                                     "\"tid\": %d, \"args\": {\"value\": %.17g}}",
+                                     sep, r.name, ts, pid, b->tid, r.value);
+                        break;
+                    case Record::ThreadName:
+                        std::fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, "
+                                     "\"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                                     sep, pid, b->tid, r.name);
+                        break;
+                    }
+                    sep = ",\n";
+                }
+            }
+        }
+        std::fprintf(out, "\n]}\n");
+        if (std::fclose(out) != 0) {
+            std::cerr << "Unable to write '" << trace_path << "'" << std::endl;
+        }
+    }
+}
+
+void TraceStart(const std::string &path) {
+    trace_path = path;
+    start_time = std::chrono::steady_clock::now();
+    start_ticks = TraceClock();
+    trace_enabled = true;
+    std::atexit(WriteTrace);
+}
+
+void TraceThreadName(const char *name) {
+    if (trace_enabled) {
+        Record r {name, TraceClock(), {0}, Record::ThreadName};
+        Append(r);
+    }
+}
+
+void TraceCounter(const char *name, double value) {
+    if (trace_enabled) {
+        Record r {name, TraceClock(), {0}, Record::Counter};
+        r.value = value;
+        Append(r);
+    }
+}
+
+void TraceComplete(const char *name, uint64_t begin, uint64_t end) {
+    Record r {name, begin, {end}, Record::Span};
+    Append(r);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Optional timeline of where time goes per thread, written at exit as Chrome
+ * trace_event JSON for chrome://tracing or Perfetto. Each thread appends
+ * fixed-size records to its own buffer without locks or atomic
+ * read-modify-writes, so a span costs two timestamp reads and a store; with
+ * tracing off it is one branch. Names must be string literals, they are
+ * stored as pointers.
+ */
+
+extern bool trace_enabled;
+
+// Enable tracing, writing the trace to <path> when the process exits.
+void TraceStart(const std::string &path);
+
+// Name the calling thread in the trace.
+void TraceThreadName(const char *name);
+
+// Record the value of a counter at the current time.
+void TraceCounter(const char *name, double value);
+
+// Raw timestamp in TSC ticks on x86, steady_clock ticks elsewhere.
+inline uint64_t TraceClock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+void TraceComplete(const char *name, uint64_t begin, uint64_t end);
+
+// Records the time between construction (or Begin()) and destruction (or
+// End()) as a span. Can be ended and begun again around a co_yield, so the
+// consumer's time is not counted.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char *name) : name(name) { Begin(); }
+    ~TraceSpan() { End(); }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    void Begin() {
+        if (trace_enabled) {
+            begin = TraceClock();
+        }
+    }
+
+    void End() {
+        if (begin) {
+            TraceComplete(name, begin, TraceClock());
+            begin = 0;
+        }
+    }
+
+private:
+    const char *name;
+    uint64_t begin = 0;
+};
@@ -0,0 +1,201 @@
+#include "Validate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    constexpr size_t block_size = 256;
+
+    // GCC/Clang vector extensions, so the same code uses SSE/AVX on the host
+    // and NEON on ARM.
+    typedef float v8f __attribute__((vector_size(32)));
+    typedef int32_t v8i __attribute__((vector_size(32)));
+    typedef double v4d __attribute__((vector_size(32)));
+    typedef int64_t v4l __attribute__((vector_size(32)));
+
+    // vectors are passed by reference to keep the calling convention
+    // independent of whether AVX is enabled
+    template <typename V>
+    void Load(V &v, const void *p) {
+        memcpy(&v, p, sizeof(v));
+    }
+
+    template <typename V>
+    bool Any(const V &mask) {
+        for (size_t i = 0; i < sizeof(V) / sizeof(mask[0]); i++) {
+            if (mask[i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char *KindName(ValidationIssue::Kind kind) {
+        switch (kind) {
+        case ValidationIssue::NotANumber: return "nan";
+        case ValidationIssue::OutOfRange: return "out of range";
+        case ValidationIssue::NonMonotonic: return "non-monotonic";
+        case ValidationIssue::Duplicate: return "duplicate";
+        case ValidationIssue::Gap: return "gap";
+        }
+        return "?";
+    }
+}
+
+uint64_t ValidationReport::Invalid() const {
+    return counts[ValidationIssue::NotANumber] + counts[ValidationIssue::OutOfRange];
+}
+
+void ValidationReport::Print(std::ostream &out) const {
+    out << "validate: rows " << rows;
+    for (int kind = 0; kind < 5; kind++) {
+        out << ", " << KindName(ValidationIssue::Kind(kind)) << " " << counts[kind];
+    }
+    out << std::endl;
+
+    for (const ValidationIssue &issue : issues) {
+        out << "validate: row " << issue.row << " t " << issue.t << ": " << KindName(issue.kind);
+        if (issue.kind >= ValidationIssue::NonMonotonic) {
+            out << " (dt " << issue.dt << ")";
+        }
+        out << std::endl;
+    }
+    uint64_t total = 0;
+    for (uint64_t count : counts) {
+        total += count;
+    }
+    if (total > issues.size()) {
+        out << "validate: " << total - issues.size() << " more issues not listed" << std::endl;
+    }
+}
+
+bool Validator::ValidValues(const Sample &s) const {
+    return !std::isnan(s.t) && !std::isnan(s.x) && !std::isnan(s.y) && !std::isnan(s.z)
+        && std::fabs(s.x) <= limits.max_g && std::fabs(s.y) <= limits.max_g && std::fabs(s.z) <= limits.max_g;
+}
+
+bool Validator::Check(std::span<const Sample> batch, ValidationReport &report) {
+    alignas(32) float x[block_size], y[block_size], z[block_size];
+    alignas(32) double t[block_size + 1];  // t[0] is the timestamp before the block
+
+    const v8f max_g = v8f {} + limits.max_g;
+    const v4d max_step = v4d {} + limits.max_step;
+    bool valid = true;
+
+    for (size_t start = 0; start < batch.size(); start += block_size) {
+        std::span<const Sample> block = batch.subspan(start, std::min(block_size, batch.size() - start));
+        size_t n = block.size();
+
+        // transpose to columns, padding the last block with rows that pass
+        t[0] = have_prev ? prev_t : block[0].t - limits.max_step / 2;
+        for (size_t i = 0; i < n; i++) {
+            t[i + 1] = block[i].t;
+            x[i] = block[i].x;
+            y[i] = block[i].y;
+            z[i] = block[i].z;
+        }
+        for (size_t i = n; i < block_size; i++) {
+            t[i + 1] = t[i] + limits.max_step / 2;
+            x[i] = y[i] = z[i] = 0;
+        }
+
+        v8i bad_values {};
+        for (size_t i = 0; i < block_size; i += 8) {
+            v8f vx, vy, vz;
+            Load(vx, x + i);
+            Load(vy, y + i);
+            Load(vz, z + i);
+            // NaN fails every ordered compare, so test for "not within range"
+            bad_values |= !(vx <= max_g && vx >= -max_g);
+            bad_values |= !(vy <= max_g && vy >= -max_g);
+            bad_values |= !(vz <= max_g && vz >= -max_g);
+        }
+
+        v4l bad_times {};
+        for (size_t i = 0; i < block_size; i += 4) {
+            v4d cur, prev;
+            Load(cur, t + i + 1);
+            Load(prev, t + i);
+            v4d dt = cur - prev;
+            bad_times |= !(dt > 0 && dt <= max_step);
+        }
+
+        if (Any(bad_values) || Any(bad_times)) {
+            valid &= Locate(block, t[0], have_prev, report);
+        }
+
+        report.rows += n;
+        for (size_t i = n; i > 0; i--) {
+            if (!std::isnan(block[i - 1].t)) {
+                prev_t = block[i - 1].t;
+                have_prev = true;
+                break;
+            }
+        }
+    }
+
+    return valid;
+}
+
+bool Validator::Locate(std::span<const Sample> block, double prev, bool have_prev_row, ValidationReport &report) {
+    bool valid = true;
+    auto add = [&report](ValidationIssue::Kind kind, uint64_t row, double t, double dt) {
+        report.counts[kind]++;
+        if (report.issues.size() < report.max_issues) {
+            report.issues.push_back({kind, row, t, dt});
+        }
+    };
+
+    for (size_t i = 0; i < block.size(); i++) {
+        const Sample &s = block[i];
+        uint64_t row = report.rows + i;
+
+        if (!ValidValues(s)) {
+            valid = false;
+            bool nan = std::isnan(s.t) || std::isnan(s.x) || std::isnan(s.y) || std::isnan(s.z);
+            add(nan ? ValidationIssue::NotANumber : ValidationIssue::OutOfRange, row, s.t, 0);
+        }
+        if (std::isnan(s.t)) {
+            continue;
+        }
+
+        if (have_prev_row) {
+            double dt = s.t - prev;
+            if (dt < 0) {
+                add(ValidationIssue::NonMonotonic, row, s.t, dt);
+            } else if (dt == 0) {
+                add(ValidationIssue::Duplicate, row, s.t, dt);
+            } else if (dt > limits.max_step) {
+                add(ValidationIssue::Gap, row, s.t, dt);
+            }
+        }
+        prev = s.t;
+        have_prev_row = true;
+    }
+
+    return valid;
+}
+
+SampleBatches Validate(SampleBatches source, ValidationLimits limits, ValidationReport &report, bool drop) {
+    Validator validator(limits);
+
+    for (auto batch : source) {
+        if (validator.Check(batch, report) || !drop) {
+            co_yield batch;
+            continue;
+        }
+
+        // pass on the runs of valid rows between invalid ones
+        size_t begin = 0;
+        for (size_t i = 0; i <= batch.size(); i++) {
+            if (i == batch.size() || !validator.ValidValues(batch[i])) {
+                if (i > begin) {
+                    co_yield batch.subspan(begin, i - begin);
+                }
+                begin = i + 1;
+            }
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "SampleSource.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+/*
+ * Input validation for replays: finds rows with NaN or out-of-range
+ * acceleration, timestamps that go backwards or repeat, and gaps. Blocks of
+ * samples are transposed to columns and checked with SIMD vector compares;
+ * only blocks that contain a problem are scanned row by row to locate it, so
+ * clean input is validated at close to memory bandwidth.
+ */
+
+struct ValidationLimits {
+    float max_g = 8;  // |x|, |y|, |z| above this are invalid
+    double max_step = 0.15;  // seconds between rows before it counts as a gap
+};
+
+struct ValidationIssue {
+    enum Kind {
+        NotANumber,
+        OutOfRange,
+        NonMonotonic,
+        Duplicate,
+        Gap,
+    };
+
+    Kind kind;
+    uint64_t row;  // index of the sample in the validated stream
+    double t;
+    double dt;  // for timestamp issues, difference to the previous row
+};
+
+struct ValidationReport {
+    uint64_t rows = 0;
+    uint64_t counts[5] = {};  // per ValidationIssue::Kind
+
+    // Only the first <max_issues> issues are kept, the counts are exact.
+    size_t max_issues = 100;
+    std::vector<ValidationIssue> issues;
+
+    uint64_t Invalid() const;
+    void Print(std::ostream &out) const;
+};
+
+class Validator {
+public:
+    explicit Validator(ValidationLimits limits = {}) : limits(limits) {}
+
+    // Check the next batch of the stream. Returns true if every row in it has
+    // valid values (timestamp issues do not count).
+    bool Check(std::span<const Sample> batch, ValidationReport &report);
+
+    // Whether <s> has valid values, the same test as in Check().
+    bool ValidValues(const Sample &s) const;
+
+private:
+    bool Locate(std::span<const Sample> block, double prev, bool have_prev_row, ValidationReport &report);
+
+    ValidationLimits limits;
+    bool have_prev = false;
+    double prev_t = 0;
+};
+
+// Validate a stream on its way to the tracker. With <drop> set, rows with
+// invalid values are left out; the rest of each batch is passed on without
+// copying.
+SampleBatches Validate(SampleBatches source, ValidationLimits limits, ValidationReport &report, bool drop);
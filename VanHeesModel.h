@@ -0,0 +1,136 @@
+#pragma once
+
+#include "P2Quantile.h"
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Shared by all scalar types, so one configuration can drive both a plain
+// and an instrumented model.
+struct VanHeesConfig {
+    float eta = 0.005f;  // exponential moving average decay factor
+    float arm_angle_threshold = 5;  // degrees, until <warmup> windows when adaptive
+
+    // Adaptive threshold: <scale> times the <quantile> of all arm angle
+    // changes seen so far, limited to [min_threshold, max_threshold],
+    // like the per-recording threshold of van Hees et al. 2018 (HDCZA).
+    bool adaptive = false;
+    float quantile = 0.1f;
+    float scale = 15;
+    float min_threshold = 2;
+    float max_threshold = 10;
+    int warmup = 720;  // windows, one hour
+
+    bool operator==(const VanHeesConfig &) const = default;
+};
+
+/*
+ * Host-side port of vanhees2015_modified() from vanhees2015.py, templated over
+ * the scalar type so the same arithmetic can be run with plain floats or with
+ * an instrumented type (see OpCount.h).
+ *
+ * Math functions are called unqualified so that overloads for custom scalar
+ * types are found through argument-dependent lookup.
+ */
+template <typename T>
+class VanHeesModel {
+public:
+    static constexpr int fs = 10;  // Hz
+    static constexpr int seconds_per_update = 5;
+    static constexpr int window_size = fs * seconds_per_update;
+    static constexpr int classification_hist_size = 60;
+
+    using Config = VanHeesConfig;
+
+    VanHeesModel() = default;
+    explicit VanHeesModel(const Config &config) : config(config) {}
+
+    // Feed one sample (in g). Returns true when this sample closed a window
+    // and a new state was classified.
+    bool Update(T x, T y, T z) {
+        using std::atan;
+        using std::sqrt;
+
+        const T eta = T(config.eta);
+        avg[0] = avg[0] + eta * (x - avg[0]);
+        avg[1] = avg[1] + eta * (y - avg[1]);
+        avg[2] = avg[2] + eta * (z - avg[2]);
+
+        angle = atan(avg[2] / sqrt(avg[0] * avg[0] + avg[1] * avg[1])) * T(180 / M_PI);
+        arm_angle_hist[hist_pos] = angle;
+        hist_pos = (hist_pos + 1) % window_size;
+
+        bool window = (samples++ % window_size) == 0;
+        if (!window) {
+            return false;
+        }
+
+        T sum = arm_angle_hist[0];
+        for (int i = 1; i < window_size; i++) {
+            sum = sum + arm_angle_hist[i];
+        }
+        T mean = sum / T(window_size);
+
+        bool classified = false;
+        if (have_mean) {
+            T d = mean - arm_angle_mean_d;
+            change = d < T(0) ? T(0) - d : d;
+            change_hist[change_pos] = change;
+            change_pos = (change_pos + 1) % classification_hist_size;
+
+            if (config.adaptive) {
+                change_quantile.Add(change);
+                if (change_quantile.Count() >= uint64_t(config.warmup)) {
+                    threshold = T(config.scale) * change_quantile.Value();
+                    threshold = threshold < T(config.min_threshold) ? T(config.min_threshold) : threshold;
+                    threshold = threshold > T(config.max_threshold) ? T(config.max_threshold) : threshold;
+                }
+            }
+
+            state = 1;
+            for (const T &c : change_hist) {
+                if (c > threshold) {
+                    state = 0;
+                    break;
+                }
+            }
+            classified = true;
+        }
+
+        arm_angle_mean_d = mean;
+        have_mean = true;
+        return classified;
+    }
+
+    uint8_t State() const { return state; }
+    const std::array<T, 3> &Averages() const { return avg; }
+    const T &ArmAngle() const { return angle; }
+    const T &ArmAngleMean() const { return arm_angle_mean_d; }
+    const T &ArmAngleChange() const { return change; }
+    const T &Threshold() const { return threshold; }
+    uint64_t Samples() const { return samples; }
+    const Config &Configuration() const { return config; }
+
+private:
+    Config config;
+
+    std::array<T, 3> avg {};
+    T angle {};
+    std::array<T, window_size> arm_angle_hist {};
+    int hist_pos = 0;
+
+    T arm_angle_mean_d {};
+    bool have_mean = false;
+
+    T change {};
+    std::array<T, classification_hist_size> change_hist {};
+    int change_pos = 0;
+
+    T threshold = T(config.arm_angle_threshold);
+    P2Quantile<T> change_quantile {config.quantile};
+
+    uint8_t state = 0;
+    uint64_t samples = 0;
+};
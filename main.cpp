@@ -1,40 +1,1102 @@
 #include "SleepTracker.h"
+#include "AngleStore.h"
+#include "Cohort.h"
+#include "Coordinator.h"
+#include "CostModel.h"
+#include "Flash.h"
+#include "Follow.h"
+#include "Hdcza.h"
+#include "HistoryLog.h"
+#include "HrScheduler.h"
+#include "Hypnogram.h"
+#include "Labels.h"
+#include "MemoryProfile.h"
+#include "Metrics.h"
+#include "OpCount.h"
+#include "PacedReplay.h"
+#include "Pyramid.h"
+#include "SampleSource.h"
+#include "SyncCodec.h"
+#include "TextSchema.h"
+#include "Trace.h"
+#include "Validate.h"
+#include "VanHeesModel.h"
 
-#include <iostream>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
 #include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
 
 float currtime = 0;
+int currstate = -1;
+std::ostream *output = &std::cout;
+
+Counter &samples_total = NewCounter("tracker_samples_total", "Samples passed to the tracker");
+Counter &transitions_total = NewCounter("tracker_transitions_total", "State changes reported by the tracker");
+Histogram &update_latency = NewHistogram("tracker_update_seconds", "Time taken by one UpdateAccel() call");
 
 void callback(uint8_t state) {
-    std::cout << currtime << " " << (int)state << std::endl;
+    transitions_total.Add();
+    currstate = state;
+    *output << currtime << " " << (int)state << std::endl;
 }
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " [INFILE]" << std::endl;
-        std::cerr << "Where [INFILE] is a whitespace-delimited file where each row holds:" << std::endl;
-        std::cerr << "  TIME X Y Z TRUTH" << std::endl;
-        std::cerr << "The input sample rate must be 10 Hz, with one row per sample." << std::endl;
-        std::cerr << "Output is one line for each change in state in format:" << std::endl;
-        std::cerr << "  TIME STATE" << std::endl;
-        std::cerr << "Where [STATE] is 0 or 1 for wake or sleep." << std::endl;
-        exit(1);
+void usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " [OPTIONS] [INFILE]..." << std::endl;
+    std::cerr << "Where [INFILE] is a whitespace-delimited file where each row holds:" << std::endl;
+    std::cerr << "  TIME X Y Z TRUTH" << std::endl;
+    std::cerr << "The input sample rate must be 10 Hz, with one row per sample." << std::endl;
+    std::cerr << "Other inputs can be given as TYPE:LOCATION, where TYPE is one of" << std::endl;
+    std::cerr << "  raw:FILE        TIME X Y Z rows at any rate, resampled to 10 Hz" << std::endl;
+    std::cerr << "  bin:FILE        native binary samples" << std::endl;
+    std::cerr << "  cwa:FILE        Axivity .cwa file, resampled to 10 Hz" << std::endl;
+    std::cerr << "  geneactiv:FILE  GENEActiv .bin file, resampled to 10 Hz" << std::endl;
+    std::cerr << "  synth:SECONDS   synthetic data" << std::endl;
+    std::cerr << "  unix:PATH       text rows from a Unix domain socket" << std::endl;
+    std::cerr << "  tcp:HOST:PORT   text rows from a TCP connection" << std::endl;
+    std::cerr << "Several inputs are merged by timestamp, dropping overlapping samples." << std::endl;
+    std::cerr << "Output is one line for each change in state in format:" << std::endl;
+    std::cerr << "  TIME STATE" << std::endl;
+    std::cerr << "Where [STATE] is 0 or 1 for wake or sleep." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --schema FILE      read text inputs with the column layout in FILE" << std::endl;
+    std::cerr << "  --from T, --to T   only process samples with T_from <= TIME < T_to" << std::endl;
+    std::cerr << "  --dedup SECONDS    drop merged samples closer than this to the previous" << std::endl;
+    std::cerr << "                     one (default 0.05)" << std::endl;
+    std::cerr << "  --fill POLICY      fill gaps in the input with none (default), hold" << std::endl;
+    std::cerr << "                     or linear" << std::endl;
+    std::cerr << "  --max-fill SECONDS leave longer gaps unfilled (default 60)" << std::endl;
+    std::cerr << "  --merge-stats      report duplicates and gaps to stderr" << std::endl;
+    std::cerr << "  --validate         report NaN or out-of-range rows, non-monotonic or" << std::endl;
+    std::cerr << "                     duplicate timestamps and gaps to stderr" << std::endl;
+    std::cerr << "  --drop-invalid     like --validate, but also leave out rows with invalid values" << std::endl;
+    std::cerr << "  --validate-only    only validate the input, exit status 2 if issues were found" << std::endl;
+    std::cerr << "  --score            compare the estimate to the truth per sample, report" << std::endl;
+    std::cerr << "                     to stderr; uses the TRUTH column unless --truth is given" << std::endl;
+    std::cerr << "  --truth [TYPE:]FILE  sleep stage labels to score against, either" << std::endl;
+    std::cerr << "                     TIME STAGE rows (text, default) or EDF+ annotations" << std::endl;
+    std::cerr << "                     (edf); implies --score" << std::endl;
+    std::cerr << "  --truth-offset S   add S seconds to label times" << std::endl;
+    std::cerr << "  --pyramid FILE     write a min/max/mean pyramid of inputs and reference" << std::endl;
+    std::cerr << "                     model intermediates to FILE, for trace_viewer.py" << std::endl;
+    std::cerr << "  --angles FILE      write prefix sums of the reference model's per-sample" << std::endl;
+    std::cerr << "                     arm angles to FILE, for --sweep" << std::endl;
+    std::cerr << "  --adaptive         classify with the reference model and a per-user threshold," << std::endl;
+    std::cerr << "                     15 times a quantile of the arm angle changes so far," << std::endl;
+    std::cerr << "                     within 2..10 degrees, after the first hour; also for" << std::endl;
+    std::cerr << "                     --follow, --cohort and --cost" << std::endl;
+    std::cerr << "  --adaptive-quantile Q" << std::endl;
+    std::cerr << "                     quantile for --adaptive (default 0.1, implies --adaptive)" << std::endl;
+    std::cerr << "  --hdcza FILE       also detect the sleep period per noon-to-noon day with" << std::endl;
+    std::cerr << "                     HDCZA, writing ONSET WAKE THRESHOLD rows to FILE, and" << std::endl;
+    std::cerr << "                     compare its throughput to the tracker's on stderr;" << std::endl;
+    std::cerr << "                     times must be seconds since a midnight, as for cwa:" << std::endl;
+    std::cerr << "                     and geneactiv: inputs, or days split at the wrong hour" << std::endl;
+    std::cerr << "  --flash FILE       also keep the on-watch sleep history (transitions and" << std::endl;
+    std::cerr << "                     per-window arm angle changes) in NOR flash emulated in" << std::endl;
+    std::cerr << "                     FILE, and report flash operations and wear to stderr" << std::endl;
+    std::cerr << "  --flash-sectors N  4 KB sectors of history flash (default 64)" << std::endl;
+    std::cerr << "  --flash-cut N      cut the power during the flash operation after the" << std::endl;
+    std::cerr << "                     first N, then report what the history recovers" << std::endl;
+    std::cerr << "  --sync             encode the transitions for BLE sync, decode them again" << std::endl;
+    std::cerr << "                     and report size and throughput to stderr" << std::endl;
+    std::cerr << "  --sync-mtu N       largest sync frame in bytes (default 244, implies --sync)" << std::endl;
+    std::cerr << "  --sync-windows     also send per-window arm angle changes; implies --sync" << std::endl;
+    std::cerr << "  --sync-step STEP   degrees per step of the window changes (default 0.25," << std::endl;
+    std::cerr << "                     implies --sync-windows)" << std::endl;
+    std::cerr << "  --hr               simulate heart rate sampling gated by arm movement and" << std::endl;
+    std::cerr << "                     tracker state against measuring at a fixed interval," << std::endl;
+    std::cerr << "                     report sensor time to stderr" << std::endl;
+    std::cerr << "  --hr-interval S    seconds between fixed-interval measurements (default" << std::endl;
+    std::cerr << "                     300, at least 30, implies --hr)" << std::endl;
+    std::cerr << "  --hr-power MW      heart rate sensor draw while on, for the energy estimate" << std::endl;
+    std::cerr << "                     (default 3, about 1 mA at 3 V)" << std::endl;
+    std::cerr << "  --cost             estimate on-watch cost by counting operations in" << std::endl;
+    std::cerr << "                     the reference model, report written to stderr" << std::endl;
+    std::cerr << "  --cost-table FILE  per-operation cycle costs for --cost (implies --cost)" << std::endl;
+    std::cerr << "  --pace SPEEDUP     release samples at SPEEDUP times the sample rate" << std::endl;
+    std::cerr << "                     (1 for real time), report latency to stderr" << std::endl;
+    std::cerr << "  --batch N          samples released together when pacing (default 1)" << std::endl;
+    std::cerr << "  --load N[:PCT]     run N threads of synthetic CPU load, busy PCT %" << std::endl;
+    std::cerr << "                     of the time (default 100)" << std::endl;
+    std::cerr << "  --metrics ADDRESS  serve live metrics in the Prometheus text format at" << std::endl;
+    std::cerr << "                     tcp:PORT (loopback) or unix:PATH while running" << std::endl;
+    std::cerr << "  --memory           report peak RSS, heap allocated per stage, resident" << std::endl;
+    std::cerr << "                     size of mapped inputs and a per-job estimate to stderr" << std::endl;
+    std::cerr << "  --trace FILE       write a per-thread timeline of reading, parsing, tracking" << std::endl;
+    std::cerr << "                     and output to FILE as Chrome trace_event JSON; cohort" << std::endl;
+    std::cerr << "                     workers write FILE.PID" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Window-length sweeps from an --angles file, without [INFILE]:" << std::endl;
+    std::cerr << "  " << prog << " --sweep FILE [--windows S,...] [--history S] [--threshold DEG]" << std::endl;
+    std::cerr << "Output is one line for each change in state per window length, in format:" << std::endl;
+    std::cerr << "  WINDOW TIME STATE" << std::endl;
+    std::cerr << "Defaults are 5 s windows, 300 s of history and a 5 degree threshold." << std::endl;
+    std::cerr << "With --truth, each window length is scored per window on stderr." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Following a text file as rows are appended to it, without [INFILE]:" << std::endl;
+    std::cerr << "  " << prog << " --follow FILE [--state STATEFILE] [--schema FILE]" << std::endl;
+    std::cerr << "State changes are written as they happen, in the same format. The state" << std::endl;
+    std::cerr << "is saved to STATEFILE (default FILE.state) after each pass, and a restart" << std::endl;
+    std::cerr << "resumes after the last row read. Stops when FILE is removed or renamed." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Cohort runs, without [INFILE]:" << std::endl;
+    std::cerr << "  " << prog << " --cohort LIST --out-dir DIR [--cache-dir DIR] [OPTIONS]" << std::endl;
+    std::cerr << "Where LIST holds one night per line as NAME INFILE... The output of each" << std::endl;
+    std::cerr << "night goes to DIR/NAME.txt, followed by its score with --score, and" << std::endl;
+    std::cerr << "DIR/manifest.txt lists cache hits and replay times. Nights whose inputs," << std::endl;
+    std::cerr << "options and binary are unchanged are copied from the cache directory." << std::endl;
+    std::cerr << "With --workers N, nights are run on N worker processes; nights whose" << std::endl;
+    std::cerr << "worker fails or dies are retried up to 3 times." << std::endl;
+    std::cerr << "With --matrix FILE, the sleep state of every night is also written to FILE" << std::endl;
+    std::cerr << "as a bit matrix of 5 s epochs, one row per noon-to-noon day; night names must" << std::endl;
+    std::cerr << "then be at most 55 bytes." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Queries on a matrix written with --matrix, without [INFILE]:" << std::endl;
+    std::cerr << "  " << prog << " --query FILE totals        NAME DAY SLEEP SCORED per row, in seconds" << std::endl;
+    std::cerr << "  " << prog << " --query FILE profile       TIME ASLEEP SCORED rows per epoch" << std::endl;
+    std::cerr << "  " << prog << " --query FILE at HH:MM[:SS] rows asleep at that time" << std::endl;
+    std::cerr << "  " << prog << " --query FILE all|any [NAME]" << std::endl;
+    std::cerr << "                     TIME STATE changes of the epochs where all (any) rows," << std::endl;
+    std::cerr << "                     or all rows of NAME, are asleep" << std::endl;
+    exit(1);
+}
+
+// Classify the stored arm angles with each window length in turn.
+int sweep(const char *path, const std::vector<double> &windows, double history, float threshold,
+          const char *truth_spec, double truth_offset) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Unable to open '" << path << "'" << std::endl;
+        return 1;
+    }
+    AngleSums sums(fd);
+
+    for (double window : windows) {
+        WindowConfig config;
+        config.window = std::max<uint64_t>(1, std::llround(window / sums.SamplePeriod()));
+        config.history = std::max<uint64_t>(1, std::llround(history / window));
+        config.threshold = threshold;
+
+        std::unique_ptr<LabelCursor> truth;
+        if (truth_spec) {
+            LabelBatches labels;
+            if (!OpenLabels(truth_spec, labels)) {
+                return 1;
+            }
+            truth = std::make_unique<LabelCursor>(std::move(labels), truth_offset);
+        }
+        SleepScore window_score;
+
+        int last = -1;
+        ClassifyWindows(sums, config, [&](double t, uint8_t state) {
+            if (state != last) {
+                std::cout << window << " " << (float)t << " " << (int)state << std::endl;
+                last = state;
+            }
+            if (truth) {
+                window_score.Add(state, truth->At(t));
+            }
+        });
+
+        if (truth) {
+            std::cerr << "window " << window << " s:" << std::endl;
+            window_score.Print(std::cerr);
+        }
+    }
+    return 0;
+}
+
+// Clock time of <seconds> after midnight as HH:MM:SS.
+std::string clock_time(double seconds) {
+    long s = std::lround(seconds) % 86400;
+    char text[16];
+    snprintf(text, sizeof(text), "%02ld:%02ld:%02ld", s / 3600, s / 60 % 60, s % 60);
+    return text;
+}
+
+// Answer <what> from a hypnogram matrix, with scan time on stderr.
+int query(const char *path, const std::vector<std::string> &what) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Unable to open '" << path << "'" << std::endl;
+        return 1;
+    }
+    HypnogramMatrix matrix(fd);
+    double epoch = matrix.Epoch();
+    auto start = std::chrono::steady_clock::now();
+
+    if (what[0] == "totals" && what.size() == 1) {
+        for (uint64_t r = 0; r < matrix.Rows(); r++) {
+            uint64_t sleep, scored;
+            matrix.Totals(r, sleep, scored);
+            std::cout << matrix.Name(r) << " " << matrix.Day(r) << " " << sleep * epoch << " " << scored * epoch
+                      << std::endl;
+        }
+    } else if (what[0] == "profile" && what.size() == 1) {
+        std::vector<uint32_t> sleep, scored;
+        matrix.Profile(sleep, scored);
+        for (size_t c = 0; c < matrix.Columns(); c++) {
+            std::cout << clock_time(matrix.DayStart() + c * epoch) << " " << sleep[c] << " " << scored[c] << std::endl;
+        }
+    } else if (what[0] == "at" && what.size() == 2) {
+        int h = 0, m = 0, sec = 0;
+        if (sscanf(what[1].c_str(), "%d:%d:%d", &h, &m, &sec) < 2) {
+            std::cerr << "Expected HH:MM[:SS], got '" << what[1] << "'" << std::endl;
+            return 1;
+        }
+        double offset = std::fmod(h * 3600 + m * 60 + sec - matrix.DayStart() + 86400, 86400);
+        size_t column = size_t(offset / epoch);
+        size_t word = column / 64;
+        uint64_t bit = uint64_t(1) << (column % 64);
+        uint64_t sleep = 0, scored = 0;
+        for (uint64_t r = 0; r < matrix.Rows(); r++) {
+            sleep += (matrix.Sleep(r)[word] & matrix.Scored(r)[word] & bit) != 0;
+            scored += (matrix.Scored(r)[word] & bit) != 0;
+        }
+        std::cout << clock_time(matrix.DayStart() + column * epoch) << " asleep " << sleep << " of " << scored
+                  << " (" << (scored ? 100.0 * sleep / scored : 0) << " %)" << std::endl;
+    } else if ((what[0] == "all" || what[0] == "any") && what.size() <= 2) {
+        std::vector<uint64_t> rows;
+        for (uint64_t r = 0; r < matrix.Rows(); r++) {
+            if (what.size() == 1 || matrix.Name(r) == what[1]) {
+                rows.push_back(r);
+            }
+        }
+        std::vector<uint64_t> reduced = matrix.Reduce(rows, what[0] == "all" && !rows.empty());
+        int last = -1;
+        for (size_t c = 0; c < matrix.Columns(); c++) {
+            int state = (reduced[c / 64] >> (c % 64)) & 1;
+            if (state != last) {
+                std::cout << clock_time(matrix.DayStart() + c * epoch) << " " << state << std::endl;
+                last = state;
+            }
+        }
+    } else {
+        std::cerr << "Unknown query '" << what[0] << "'" << std::endl;
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "query: rows " << matrix.Rows() << " in " << seconds << " s ("
+              << (seconds > 0 ? matrix.Rows() / seconds : 0) << " rows/s)" << std::endl;
+    return 0;
+}
+
+// Total size of the input files, for the memory estimate.
+uint64_t input_size(const std::vector<std::string> &inputs) {
+    uint64_t total = 0;
+    for (const std::string &spec : inputs) {
+        std::string type, location;
+        SplitSourceSpec(spec, type, location);
+        struct stat st;
+        if (type != "synth" && type != "unix" && type != "tcp" && stat(location.c_str(), &st) == 0) {
+            total += st.st_size;
+        }
+    }
+    return total;
+}
+
+// Open <inputs> as one stream, merged if there are several, and sliced to
+// [from, to).
+bool open_inputs(const std::vector<std::string> &inputs, const TextSchema &schema, const MergePolicy &policy,
+                 bool merge_stats, MergeStats &stats, double from, double to, SampleBatches &source) {
+    std::vector<SampleBatches> sources(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (!OpenSource(inputs[i], sources[i], schema)) {
+            return false;
+        }
+    }
+    bool merge = sources.size() > 1 || policy.fill != MergePolicy::Fill::None || merge_stats;
+    source = merge ? Merge(std::move(sources), policy, &stats) : std::move(sources[0]);
+    if (std::isfinite(from) || std::isfinite(to)) {
+        source = TimeSlice(std::move(source), from, to);
+    }
+    return true;
+}
+
+int run(int argc, char *argv[]) {
+    std::vector<std::string> inputs;
+    double from = -INFINITY, to = INFINITY;
+    TextSchema schema = TextSchema::Native(false);  // the tracker does not need TRUTH
+    bool schema_loaded = false;
+    const char *schema_path = nullptr;
+    const char *follow_path = nullptr;
+    std::string state_path;
+    const char *cohort_path = nullptr;
+    const char *out_dir = nullptr;
+    const char *cache_dir = "";
+    unsigned workers = 0;
+    bool worker = false;
+    std::string trace_path;
+    const char *metrics_address = nullptr;
+    bool memory = false;
+    bool adaptive = false;
+    const char *hdcza_path = nullptr;
+    const char *matrix_path = nullptr;
+    const char *flash_path = nullptr;
+    FlashGeometry flash_geometry;
+    long flash_cut = -1;
+    bool hr = false;
+    double hr_interval = 300;
+    double hr_power = 3;
+    bool sync = false;
+    SyncConfig sync_config;
+    const char *query_path = nullptr;
+    VanHeesModel<float>::Config model_config;
+    bool score = false;
+    const char *truth_spec = nullptr;
+    double truth_offset = 0;
+    const char *pyramid_path = nullptr;
+    const char *angles_path = nullptr;
+    const char *sweep_path = nullptr;
+    std::vector<double> sweep_windows;
+    double sweep_history = 300;
+    float sweep_threshold = 5;
+    MergePolicy merge_policy;
+    bool merge_stats = false;
+    bool validate = false, drop_invalid = false, validate_only = false;
+    bool cost = false;
+    CostModel cost_model;
+    double pace = 0;
+    int batch_size = 1;
+    int load_threads = 0, load_percent = 100;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--schema") == 0 && i + 1 < argc) {
+            schema_path = argv[++i];
+            if (!schema.Load(schema_path)) {
+                exit(1);
+            }
+            schema_loaded = true;
+        } else if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            from = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+            to = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--dedup") == 0 && i + 1 < argc) {
+            merge_policy.dedup = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--fill") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "none") == 0) {
+                merge_policy.fill = MergePolicy::Fill::None;
+            } else if (strcmp(argv[i], "hold") == 0) {
+                merge_policy.fill = MergePolicy::Fill::Hold;
+            } else if (strcmp(argv[i], "linear") == 0) {
+                merge_policy.fill = MergePolicy::Fill::Linear;
+            } else {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--max-fill") == 0 && i + 1 < argc) {
+            merge_policy.max_fill = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--merge-stats") == 0) {
+            merge_stats = true;
+        } else if (strcmp(argv[i], "--validate") == 0) {
+            validate = true;
+        } else if (strcmp(argv[i], "--drop-invalid") == 0) {
+            validate = drop_invalid = true;
+        } else if (strcmp(argv[i], "--validate-only") == 0) {
+            validate = validate_only = true;
+        } else if (strcmp(argv[i], "--score") == 0) {
+            score = true;
+        } else if (strcmp(argv[i], "--truth") == 0 && i + 1 < argc) {
+            score = true;
+            truth_spec = argv[++i];
+        } else if (strcmp(argv[i], "--truth-offset") == 0 && i + 1 < argc) {
+            truth_offset = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--pyramid") == 0 && i + 1 < argc) {
+            pyramid_path = argv[++i];
+        } else if (strcmp(argv[i], "--angles") == 0 && i + 1 < argc) {
+            angles_path = argv[++i];
+        } else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+            sweep_path = argv[++i];
+        } else if (strcmp(argv[i], "--windows") == 0 && i + 1 < argc) {
+            for (char *p = argv[++i], *end; *p; p = *end ? end + 1 : end) {
+                sweep_windows.push_back(strtod(p, &end));
+                if (end == p || sweep_windows.back() <= 0) {
+                    usage(argv[0]);
+                }
+            }
+        } else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc) {
+            sweep_history = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            sweep_threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--follow") == 0 && i + 1 < argc) {
+            follow_path = argv[++i];
+        } else if (strcmp(argv[i], "--state") == 0 && i + 1 < argc) {
+            state_path = argv[++i];
+        } else if (strcmp(argv[i], "--cohort") == 0 && i + 1 < argc) {
+            cohort_path = argv[++i];
+        } else if (strcmp(argv[i], "--out-dir") == 0 && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--worker") == 0) {
+            worker = true;
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metrics_address = argv[++i];
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            adaptive = model_config.adaptive = true;
+        } else if (strcmp(argv[i], "--adaptive-quantile") == 0 && i + 1 < argc) {
+            adaptive = model_config.adaptive = true;
+            model_config.quantile = atof(argv[++i]);
+            if (model_config.quantile <= 0 || model_config.quantile >= 1) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--hdcza") == 0 && i + 1 < argc) {
+            hdcza_path = argv[++i];
+        } else if (strcmp(argv[i], "--flash") == 0 && i + 1 < argc) {
+            flash_path = argv[++i];
+        } else if (strcmp(argv[i], "--flash-sectors") == 0 && i + 1 < argc) {
+            char *end;
+            long sectors = strtol(argv[++i], &end, 10);
+            // addresses are 32 bits
+            if (*end || sectors < 2 || uint64_t(sectors) * flash_geometry.sector_size > UINT32_MAX) {
+                usage(argv[0]);
+            }
+            flash_geometry.sectors = sectors;
+        } else if (strcmp(argv[i], "--flash-cut") == 0 && i + 1 < argc) {
+            flash_cut = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--hr") == 0) {
+            hr = true;
+        } else if (strcmp(argv[i], "--hr-interval") == 0 && i + 1 < argc) {
+            hr = true;
+            hr_interval = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--hr-power") == 0 && i + 1 < argc) {
+            hr_power = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--sync") == 0) {
+            sync = true;
+        } else if (strcmp(argv[i], "--sync-mtu") == 0 && i + 1 < argc) {
+            sync = true;
+            sync_config.mtu = std::max(atol(argv[++i]), 0L);
+        } else if (strcmp(argv[i], "--sync-windows") == 0) {
+            sync = sync_config.windows = true;
+        } else if (strcmp(argv[i], "--sync-step") == 0 && i + 1 < argc) {
+            sync = sync_config.windows = true;
+            sync_config.change_step = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--matrix") == 0 && i + 1 < argc) {
+            matrix_path = argv[++i];
+        } else if (strcmp(argv[i], "--query") == 0 && i + 1 < argc) {
+            query_path = argv[++i];
+        } else if (strcmp(argv[i], "--memory") == 0) {
+            memory = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--cost") == 0) {
+            cost = true;
+        } else if (strcmp(argv[i], "--cost-table") == 0 && i + 1 < argc) {
+            cost = true;
+            if (!cost_model.Load(argv[++i])) {
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--pace") == 0 && i + 1 < argc) {
+            pace = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            char *end;
+            load_threads = strtol(argv[++i], &end, 10);
+            if (*end == ':') {
+                load_percent = atoi(end + 1);
+            }
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            usage(argv[0]);
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+    memory_profiling = memory;
+    if (!trace_path.empty()) {
+        if (worker) {
+            trace_path += "." + std::to_string(getpid());
+        }
+        TraceStart(trace_path);
+        TraceThreadName(worker ? "worker" : "main");
+    }
+
+    std::unique_ptr<MetricsServer> metrics;
+    if (metrics_address && !worker) {
+        metrics = std::make_unique<MetricsServer>(metrics_address);
+    }
+
+    if (sweep_path) {
+        if (sweep_windows.empty()) {
+            sweep_windows.push_back(VanHeesModel<float>::seconds_per_update);
+        }
+        return sweep(sweep_path, sweep_windows, sweep_history, sweep_threshold, truth_spec, truth_offset);
+    }
+    if (query_path) {
+        // the remaining arguments are the query
+        if (inputs.empty() || cohort_path || follow_path) {
+            usage(argv[0]);
+        }
+        return query(query_path, inputs);
     }
+    if (follow_path) {
+        if (!inputs.empty() || cohort_path) {
+            usage(argv[0]);
+        }
+        if (state_path.empty()) {
+            state_path = std::string(follow_path) + ".state";
+        }
+        Follower follower(follow_path, state_path, schema, model_config, [](double t, uint8_t state) {
+            std::cout << (float)t << " " << (int)state << std::endl;
+        });
+        return follower.Run();
+    }
+    if (matrix_path && !cohort_path) {
+        usage(argv[0]);
+    }
+    if (cohort_path && (!out_dir || !inputs.empty() || truth_spec || pyramid_path || angles_path
+                        || validate_only || cost || pace > 0 || flash_path || sync || hr || hdcza_path)) {
+        usage(argv[0]);
+    }
+    if (!cohort_path && inputs.empty()) {
+        usage(argv[0]);
+    }
+    if (pace < 0 || batch_size < 1 || load_threads < 0
+        || sync_config.mtu < 8 || sync_config.change_step <= 0 || hr_interval < HrSchedulerConfig().measure_seconds
+        || load_percent < 0 || load_percent > 100) {
+        usage(argv[0]);
+    }
+
+    if (score && !truth_spec) {
+        if (!schema_loaded) {
+            schema = TextSchema::Native(true);
+        } else if (schema.columns[TextSchema::Truth].index < 0 && schema.columns[TextSchema::Truth].name.empty()) {
+            std::cerr << "--score needs a truth column in the schema, or --truth" << std::endl;
+            exit(1);
+        }
+    }
+
+    if (cohort_path) {
+        std::vector<Night> nights;
+        if (!LoadCohort(cohort_path, nights) || (matrix_path && !CheckHypnogramNames(nights))) {
+            exit(1);
+        }
+
+        // everything that changes the result of a night
+        std::ostringstream settings;
+        settings.precision(17);
+        settings << "from " << from << " to " << to << " dedup " << merge_policy.dedup
+                 << " fill " << int(merge_policy.fill) << " max-fill " << merge_policy.max_fill
+                 << " drop-invalid " << drop_invalid << " score " << score << " adaptive " << adaptive
+                 << " quantile " << model_config.quantile;
+        Hasher config;
+        config.Update(settings.str());
+        if (schema_path && !HashFile(schema_path, config)) {
+            exit(1);
+        }
+
+        auto replay = [&](const Night &night, std::ostream &out) {
+            SampleBatches source;
+            MergeStats night_stats;
+            if (!open_inputs(night.inputs, schema, merge_policy, false, night_stats, from, to, source)) {
+                return false;
+            }
+            ValidationReport night_validation;
+            if (drop_invalid) {
+                source = Validate(std::move(source), {}, night_validation, true);
+            }
+
+            currtime = 0;
+            currstate = -1;
+            output = &out;
+            auto tracker = Pinetime::SleepTracker::VanHeesSleepTracker();
+            tracker.Init(callback);
+            VanHeesModel<float> adaptive_model(model_config);
+            SleepScore night_score;
+            for (auto batch : source) {
+                for (const Sample &s : batch) {
+                    currtime = s.t;
+                    if (!adaptive) {
+                        tracker.UpdateAccel(s.x, s.y, s.z);
+                    } else if (adaptive_model.Update(s.x, s.y, s.z) && adaptive_model.State() != currstate) {
+                        callback(adaptive_model.State());
+                    }
+                    if (score) {
+                        night_score.Add(currstate, int(s.truth));
+                    }
+                }
+            }
+            output = &std::cout;
+            if (score) {
+                night_score.Print(out);
+            }
+            // where the input ended, for the hypnogram matrix
+            out << "# end " << currtime << std::endl;
+            return true;
+        };
+
+        CohortRunner runner(out_dir, cache_dir, config.Final(), replay);
+        if (worker) {
+            return ServeWorker(nights, runner);
+        }
+
+        CohortStats cohort;
+        bool ok;
+        if (workers > 0) {
+            // workers run with the same options, minus --workers
+            std::vector<std::string> args;
+            for (int i = 0; i < argc; i++) {
+                if (strcmp(argv[i], "--workers") == 0) {
+                    i++;
+                } else {
+                    args.push_back(argv[i]);
+                }
+            }
+            args.push_back("--worker");
 
-    std::ifstream infile(argv[1]);
-    if (!infile.is_open()) {
-        std::cerr << "Unable to open '" << argv[1] << "'" << std::endl;
-        exit(1);
+            std::vector<NightResult> results;
+            CoordinatorStats coordinator;
+            ok = runner.Prepare() && Coordinate(nights, runner, workers, args, 3, results, coordinator)
+                && WriteManifest(nights, results, out_dir, cohort);
+            std::cerr << "coordinator: workers " << workers << ", steals " << coordinator.steals
+                      << ", retries " << coordinator.retries << ", restarts " << coordinator.restarts << std::endl;
+        } else {
+            ok = RunCohort(nights, runner, out_dir, cohort);
+        }
+        if (ok && matrix_path) {
+            TraceSpan span("hypnogram matrix");
+            ok = BuildHypnogram(nights, out_dir, matrix_path);
+        }
+        std::cerr << "cohort: nights " << cohort.nights << ", hits " << cohort.hits
+                  << " (" << (cohort.nights ? 100.0 * cohort.hits / cohort.nights : 0) << " %)"
+                  << ", replayed " << cohort.replay_seconds << " s, saved " << cohort.saved_seconds << " s"
+                  << std::endl;
+        return ok ? 0 : 1;
     }
 
+    std::unique_ptr<LabelCursor> truth;
+    if (truth_spec) {
+        LabelBatches labels;
+        if (!OpenLabels(truth_spec, labels)) {
+            exit(1);
+        }
+        truth = std::make_unique<LabelCursor>(std::move(labels), truth_offset);
+    }
+    SleepScore sleep_score;
+
+    uint64_t baseline_rss = CurrentRss();
+    SampleBatches source;
+    MergeStats stats;
+    {
+        MemoryStageScope stage(InputStage);
+        if (!open_inputs(inputs, schema, merge_policy, merge_stats, stats, from, to, source)) {
+            exit(1);
+        }
+    }
+
+    ValidationReport validation;
+    if (validate_only) {
+        Validator validator;
+        for (auto batch : source) {
+            validator.Check(batch, validation);
+        }
+        validation.Print(std::cerr);
+        return validation.issues.empty() ? 0 : 2;
+    }
+    if (validate) {
+        source = Validate(std::move(source), {}, validation, drop_invalid);
+    }
+
+    MemoryStageScope tracker_stage(TrackerStage);
     auto tracker = Pinetime::SleepTracker::VanHeesSleepTracker();
     tracker.Init(callback);
 
-    float t, x, y, z, truth;
-    while (infile >> t >> x >> y >> z >> truth) {
-        currtime = t;
-        tracker.UpdateAccel(x, y, z);
+    // with --adaptive, the reference model replaces the tracker
+    VanHeesModel<float> adaptive_model(model_config);
+
+    // reference model run alongside the tracker when estimating cost
+    VanHeesModel<OpCount<float>> model(model_config);
+    OpCounts sample_counts, window_counts;
+    uint64_t samples = 0, windows = 0;
+
+    // reference model run alongside the tracker to record its intermediates
+    VanHeesModel<float> trace_model;
+    tracker_stage.End();
+
+    std::unique_ptr<PyramidWriter> pyramid;
+    std::unique_ptr<AngleSumWriter> angles;
+    {
+        MemoryStageScope stage(OutputStage);
+        if (pyramid_path) {
+            pyramid = std::make_unique<PyramidWriter>(
+                pyramid_path,
+                std::vector<std::string> {"x", "y", "z", "avg x", "avg y", "avg z", "arm angle", "angle change"},
+                1.0 / VanHeesModel<float>::fs);
+        }
+        if (angles_path) {
+            angles = std::make_unique<AngleSumWriter>(angles_path, 1.0 / VanHeesModel<float>::fs);
+        }
+    }
+
+    MemoryStageScope analysis_stage(AnalysisStage);
+    std::ofstream hdcza_out;
+    std::unique_ptr<HdczaDetector> hdcza;
+    uint64_t hdcza_periods = 0;
+    Clock::duration hdcza_time {}, tracker_time {};
+    if (hdcza_path) {
+        hdcza_out.open(hdcza_path);
+        if (!hdcza_out) {
+            std::cerr << "Unable to open '" << hdcza_path << "'" << std::endl;
+            exit(1);
+        }
+        hdcza = std::make_unique<HdczaDetector>(HdczaConfig(), [&](double onset, double wake, float threshold) {
+            hdcza_out << onset << " " << wake << " " << threshold << std::endl;
+            hdcza_periods++;
+        });
+    }
+
+    // on-watch history, fed the tracker's transitions and the reference
+    // model's arm angle changes
+    std::unique_ptr<FlashEmulator> flash;
+    std::unique_ptr<HistoryLog> history;
+    int logged_state = -1;
+    uint64_t logged_transitions = 0;
+    bool power_lost = false;
+    Clock::duration history_time {};
+    if (flash_path) {
+        flash = std::make_unique<FlashEmulator>(flash_path, flash_geometry);
+        history = std::make_unique<HistoryLog>(*flash);
+        if (flash_cut >= 0) {
+            flash->CutPowerAfter(flash_cut);
+        }
+    }
+
+    // tracker output for the sync benchmark, encoded after the replay
+    std::vector<std::pair<double, uint8_t>> sync_transitions;
+    std::vector<std::pair<double, float>> sync_windows;
+    int synced_state = -1;
+    uint64_t sync_text_bytes = 0;
+    double first_time = NAN;
+
+    // heart rate sampling, gated and at a fixed interval, once per window
+    HrSchedulerConfig hr_config;
+    HrScheduler hr_gated(hr_config);
+    FixedHrSchedule hr_fixed(hr_config, hr_interval);
+    HrUsage gated_usage(hr_config), fixed_usage(hr_config);
+    double hr_first = NAN;
+    analysis_stage.End();
+
+    std::unique_ptr<CpuLoad> load;
+    if (load_threads > 0) {
+        load = std::make_unique<CpuLoad>(load_threads, load_percent);
+    }
+
+    using seconds = std::chrono::duration<double>;
+    Pacer pacer(pace > 0 ? std::chrono::duration_cast<Clock::duration>(
+                    seconds(batch_size / (VanHeesModel<float>::fs * pace)))
+                : Clock::duration::zero());
+
+    int in_batch = 0;
+    uint64_t total = 0;
+    for (auto batch : source) {
+        if (hdcza) {
+            MemoryStageScope stage(AnalysisStage);
+            Clock::time_point start = Clock::now();
+            for (const Sample &s : batch) {
+                hdcza->Update(s.t, s.x, s.y, s.z);
+            }
+            hdcza_time += Clock::now() - start;
+        }
+
+        TraceSpan tracking("track");
+        Clock::time_point tracking_start = hdcza ? Clock::now() : Clock::time_point();
+        for (const Sample &s : batch) {
+            if (pace > 0 && in_batch == 0) {
+                pacer.WaitRelease();
+            }
+
+            currtime = s.t;
+            Clock::time_point start = metrics_enabled ? Clock::now() : Clock::time_point();
+            MemoryStageScope stage(TrackerStage);
+            if (!adaptive) {
+                tracker.UpdateAccel(s.x, s.y, s.z);
+            } else if (adaptive_model.Update(s.x, s.y, s.z) && adaptive_model.State() != currstate) {
+                callback(adaptive_model.State());
+            }
+            if (metrics_enabled) {
+                update_latency.Observe(Clock::now() - start);
+            }
+
+            if (score) {
+                sleep_score.Add(currstate, truth ? truth->At(s.t) : int(s.truth));
+            }
+
+            bool window = false;
+            if (pyramid || angles || history || sync_config.windows || hr) {
+                window = trace_model.Update(s.x, s.y, s.z);
+            }
+            stage.End();
+
+            if (pyramid || angles) {
+                MemoryStageScope stage(OutputStage);
+                if (angles) {
+                    angles->Add(s.t, trace_model.ArmAngle());
+                }
+                if (pyramid) {
+                    const auto &avg = trace_model.Averages();
+                    float values[] = {s.x, s.y, s.z, avg[0], avg[1], avg[2],
+                                      trace_model.ArmAngle(), trace_model.ArmAngleChange()};
+                    pyramid->Add(s.t, values);
+                }
+            }
+            if (history && !power_lost) {
+                MemoryStageScope stage(AnalysisStage);
+                Clock::time_point start = Clock::now();
+                try {
+                    if (currstate >= 0 && currstate != logged_state) {
+                        history->AddTransition(s.t, currstate);
+                        logged_state = currstate;
+                        logged_transitions++;
+                    }
+                    if (window) {
+                        history->AddWindow(s.t, trace_model.ArmAngleChange());
+                    }
+                } catch (const PowerLoss &) {
+                    power_lost = true;
+                }
+                history_time += Clock::now() - start;
+            }
+            if (hr && window) {
+                MemoryStageScope stage(AnalysisStage);
+                float change = trace_model.ArmAngleChange();
+                uint8_t state = std::max(currstate, 0);
+                if (std::isnan(hr_first)) {
+                    hr_first = s.t;
+                }
+                bool gated_on = hr_gated.Update(s.t, change, state);
+                gated_usage.Add(s.t, gated_on, hr_gated.Started(), change, state);
+                bool fixed_on = hr_fixed.Update(s.t, change, state);
+                fixed_usage.Add(s.t, fixed_on, hr_fixed.Started(), change, state);
+            }
+            if (sync) {
+                MemoryStageScope stage(AnalysisStage);
+                if (std::isnan(first_time)) {
+                    first_time = s.t;
+                }
+                if (currstate >= 0 && currstate != synced_state) {
+                    sync_transitions.push_back({s.t, currstate});
+                    sync_text_bytes += snprintf(nullptr, 0, "%g %d\n", currtime, currstate);
+                    synced_state = currstate;
+                }
+                if (window && sync_config.windows) {
+                    sync_windows.push_back({s.t, trace_model.ArmAngleChange()});
+                }
+            }
+
+            if (cost) {
+                // the first window only sets the mean, it is billed as neither
+                bool closes = model.Samples() % model.window_size == 0;
+                OpCounts before = OpCounts::Current();
+                bool window = model.Update(s.x, s.y, s.z);
+                if (window) {
+                    window_counts += OpCounts::Current() - before;
+                    windows++;
+                } else if (!closes) {
+                    sample_counts += OpCounts::Current() - before;
+                    samples++;
+                }
+            }
+
+            if (pace > 0 && ++in_batch == batch_size) {
+                pacer.Done();
+                in_batch = 0;
+            }
+        }
+        if (hdcza) {
+            tracker_time += Clock::now() - tracking_start;
+        }
+        total += batch.size();
+        samples_total.Add(batch.size());
+        TraceCounter("samples", total);
+    }
+    if (pace > 0 && in_batch > 0) {
+        pacer.Done();
+    }
+
+    TraceSpan writing("write outputs");
+    MemoryStageScope output_stage(OutputStage);
+    if (pyramid && !pyramid->Finish()) {
+        return 1;
+    }
+    if (angles && !angles->Finish()) {
+        return 1;
+    }
+    writing.End();
+    if (score) {
+        sleep_score.Print(std::cerr);
+    }
+    if (validate) {
+        validation.Print(std::cerr);
+    }
+    if (merge_stats) {
+        std::cerr << "merge: samples " << stats.samples << ", duplicates " << stats.duplicates
+                  << ", gaps " << stats.gaps << " (" << stats.gap_seconds << " s)"
+                  << ", filled " << stats.filled << std::endl;
+    }
+    if (pace > 0) {
+        pacer.Report(std::cerr);
+    }
+    if (cost) {
+        cost_model.Report(std::cerr, sample_counts, samples, window_counts, windows,
+                          VanHeesModel<float>::fs);
+    }
+    if (hdcza) {
+        MemoryStageScope stage(AnalysisStage);
+        hdcza->Finish();
+        using seconds = std::chrono::duration<double>;
+        double hdcza_rate = total / std::max(seconds(hdcza_time).count(), 1e-9);
+        double tracker_rate = total / std::max(seconds(tracker_time).count(), 1e-9);
+        std::cerr << "hdcza: " << hdcza_periods << " sleep periods, threshold " << hdcza->Threshold()
+                  << " degrees" << std::endl;
+        std::cerr << "hdcza: " << hdcza_rate / 1e6 << " M samples/s, tracker loop " << tracker_rate / 1e6
+                  << " M samples/s" << std::endl;
+    }
+    if (history) {
+        MemoryStageScope stage(AnalysisStage);
+        try {
+            if (!power_lost) {
+                history->Commit();
+            }
+        } catch (const PowerLoss &) {
+            power_lost = true;
+        }
+
+        const FlashStats &stats = flash->Stats();
+        auto [least, most] = std::minmax_element(stats.sector_erases.begin(), stats.sector_erases.end());
+        double payload = std::max<uint64_t>(history->PayloadBytes(), 1);
+        std::cerr << "flash: " << history->Records() << " records, payload " << history->PayloadBytes()
+                  << " bytes, store time " << seconds(history_time).count() << " s" << std::endl;
+        std::cerr << "flash: programs " << stats.programs << " (" << stats.program_bytes << " bytes), erases "
+                  << stats.erases << ", write amplification " << stats.program_bytes / payload << ", "
+                  << stats.erases * 1e6 / payload << " erases per MB" << std::endl;
+        uint32_t least_worn, most_worn;
+        history->Wear(least_worn, most_worn);
+        std::cerr << "flash: sector erases min " << *least << ", max " << *most << " (lifetime " << least_worn
+                  << " to " << most_worn << "), dropped " << history->DroppedSectors() << " sectors of history"
+                  << std::endl;
+
+        // read it back as the watch would after a restart
+        HistoryLog recovered(*flash);
+        uint64_t transitions = 0, summaries = 0;
+        recovered.Replay([&](double, uint8_t) { transitions++; }, [&](double, float) { summaries++; });
+        std::cerr << "flash: " << (power_lost ? "after power loss, " : "") << "recovered " << transitions
+                  << " transitions (" << logged_transitions << " logged in this run), " << summaries
+                  << " windows, " << recovered.TornRecords() << " torn records" << std::endl;
+    }
+    if (sync) {
+        MemoryStageScope stage(AnalysisStage);
+        // encode and decode repeatedly for a stable throughput
+        std::vector<std::vector<uint8_t>> frames;
+        uint64_t decoded_transitions = 0, decoded_windows = 0;
+        double time_error = 0, change_error = 0;
+        bool valid = true;
+        Clock::duration encode_time {}, decode_time {};
+        int rounds = 0;
+        do {
+            frames.clear();
+            Clock::time_point start = Clock::now();
+            SyncEncoder encoder(sync_config, [&](std::span<const uint8_t> frame) {
+                frames.emplace_back(frame.begin(), frame.end());
+            });
+            for (const auto &[t, state] : sync_transitions) {
+                encoder.AddTransition(t, state);
+            }
+            for (const auto &[t, change] : sync_windows) {
+                encoder.AddWindow(t, change);
+            }
+            encoder.Finish();
+            encode_time += Clock::now() - start;
+
+            start = Clock::now();
+            decoded_transitions = decoded_windows = 0;
+            SyncDecoder decoder(sync_config,
+                [&](double t, uint8_t state) {
+                    if (decoded_transitions < sync_transitions.size()) {
+                        const auto &original = sync_transitions[decoded_transitions];
+                        time_error = std::max(time_error, std::abs(t - original.first));
+                        valid &= state == original.second;
+                    }
+                    decoded_transitions++;
+                },
+                [&](double t, float change) {
+                    if (decoded_windows < sync_windows.size()) {
+                        const auto &original = sync_windows[decoded_windows];
+                        time_error = std::max(time_error, std::abs(t - original.first));
+                        float saturated = std::min(original.second, 0xbf * sync_config.change_step);
+                        change_error = std::max(change_error, double(std::abs(change - saturated)));
+                    }
+                    decoded_windows++;
+                });
+            for (const auto &frame : frames) {
+                valid &= decoder.Decode(frame);
+            }
+            decode_time += Clock::now() - start;
+            rounds++;
+        } while (seconds(encode_time + decode_time).count() < 0.1);
+
+        uint64_t bytes = 0;
+        for (const auto &frame : frames) {
+            bytes += frame.size();
+        }
+        double days = std::max(double(currtime) - first_time, 1.0) / 86400;
+        double items = double(rounds) * (sync_transitions.size() + sync_windows.size());
+        std::cerr << "sync: " << frames.size() << " frames, " << bytes << " bytes, " << bytes / days
+                  << " bytes per 24 h; as text " << sync_text_bytes << " bytes";
+        if (sync_config.windows) {
+            std::cerr << ", windows as float32 time and change " << sync_windows.size() * 8 << " bytes";
+        }
+        std::cerr << std::endl;
+        std::cerr << "sync: encode " << items / seconds(encode_time).count() / 1e6 << " M items/s, decode "
+                  << items / seconds(decode_time).count() / 1e6 << " M items/s" << std::endl;
+        std::cerr << "sync: decoded " << decoded_transitions << " of " << sync_transitions.size() << " transitions, "
+                  << decoded_windows << " of " << sync_windows.size() << " windows, max error " << time_error
+                  << " s, " << change_error << " degrees" << (valid ? "" : ", MISMATCH") << std::endl;
+    }
+    if (hr) {
+        MemoryStageScope stage(AnalysisStage);
+        gated_usage.Finish();
+        fixed_usage.Finish();
+        double days = std::max(double(currtime) - hr_first, 1.0) / 86400;
+        fixed_usage.Print(std::cerr, "hr fixed", days, hr_power);
+        gated_usage.Print(std::cerr, "hr gated", days, hr_power);
+        std::cerr << "hr: gated sensor time " << 100 * gated_usage.OnSeconds() / std::max(fixed_usage.OnSeconds(), 1.0)
+                  << " % of fixed interval" << std::endl;
+    }
+    if (adaptive) {
+        std::cerr << "adaptive: threshold " << adaptive_model.Threshold() << " degrees after "
+                  << adaptive_model.Samples() / VanHeesModel<float>::window_size << " windows" << std::endl;
+    }
+    if (memory) {
+        source = SampleBatches();  // unmap inputs so their residency is counted
+        MemoryReport(std::cerr, baseline_rss, input_size(inputs));
     }
 
     return 0;
 }
+
+int main(int argc, char *argv[]) {
+    try {
+        return run(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
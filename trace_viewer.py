@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""
+Zoomable viewer for trace pyramids written by `main --pyramid FILE`. Only the pyramid level and time
+range needed for the current view are read from the memory-mapped file, so panning across days of
+data stays interactive.
+
+"""
+
+import numpy as np
+import matplotlib.pyplot as plt
+
+
+class Pyramid:
+    """Memory-mapped trace pyramid, see Pyramid.h for the file layout."""
+
+    def __init__(self, path):
+        self.mm = np.memmap(path, dtype=np.uint8, mode="r")
+        if bytes(self.mm[:8]) != b"TRACEPYR":
+            raise ValueError(f"{path} is not a trace pyramid")
+
+        channels, levels = np.frombuffer(self.mm, dtype="<u4", count=2, offset=8)
+        self.t0, self.dt = np.frombuffer(self.mm, dtype="<f8", count=2, offset=16)
+        self.samples = int(np.frombuffer(self.mm, dtype="<u8", count=1, offset=32)[0])
+
+        names = np.frombuffer(self.mm, dtype="S16", count=channels, offset=40)
+        self.channels = [name.decode() for name in names]
+
+        table = 40 + 16*channels
+        offsets = np.frombuffer(self.mm, dtype="<u8", count=levels, offset=table)
+        counts = np.frombuffer(self.mm, dtype="<u8", count=levels, offset=table + 8*levels)
+        self.levels = [np.ndarray((int(n), channels, 3), dtype="<f4", buffer=self.mm, offset=int(o))
+                       for o, n in zip(offsets, counts)]
+
+    def fetch(self, t_from, t_to, max_points):
+        """Return times and (n, channels, 3) min/max/mean entries covering [t_from, t_to] from the
+        finest level with at most <max_points> entries in that range.
+
+        """
+
+        span = max(t_to - t_from, self.dt) / self.dt  # in samples
+        level = int(np.clip(np.ceil(np.log2(max(span / max_points, 1))), 0, len(self.levels) - 1))
+        step = self.dt * 2**level
+
+        data = self.levels[level]
+        first = int(np.clip(np.floor((t_from - self.t0) / step), 0, len(data)))
+        last = int(np.clip(np.ceil((t_to - self.t0) / step) + 1, first, len(data)))
+        t = self.t0 + step*(np.arange(first, last) + 0.5*(level > 0))
+        return t, np.asarray(data[first:last])
+
+
+def view(pyramid, max_points=2000):
+    groups = [
+        ("Acceleration [g]", ["x", "avg x"]),
+        ("Acceleration [g]", ["y", "avg y"]),
+        ("Acceleration [g]", ["z", "avg z"]),
+        ("Angle [deg]", ["arm angle"]),
+        ("Angle [deg]", ["angle change"]),
+    ]
+
+    fig, axes = plt.subplots(len(groups), 1, sharex=True, figsize=(24, 18), tight_layout=True)
+    artists = []
+    updating = [False]
+
+    def update(ax=None):
+        if updating[0]:
+            return
+        updating[0] = True
+
+        t_from, t_to = axes[0].get_xlim()
+        t, data = pyramid.fetch(t_from, t_to, max_points)
+        for artist in artists:
+            artist.remove()
+        artists.clear()
+
+        for ax, (ylabel, names) in zip(axes, groups):
+            for name in names:
+                c = pyramid.channels.index(name)
+                line, = ax.plot(t, data[:, c, 2], label=name)
+                artists.append(line)
+                artists.append(ax.fill_between(t, data[:, c, 0], data[:, c, 1],
+                                               color=line.get_color(), alpha=0.3, linewidth=0))
+            ax.legend(loc="upper right")
+
+        fig.canvas.draw_idle()
+        updating[0] = False
+
+    t_end = pyramid.t0 + pyramid.dt*pyramid.samples
+    for ax, (ylabel, names) in zip(axes, groups):
+        ax.grid()
+        ax.set_ylabel(ylabel)
+        ax.set_xlim((pyramid.t0, t_end))
+    axes[-1].set_xlabel("time [s]")
+
+    update()
+    axes[0].callbacks.connect("xlim_changed", update)
+    plt.show()
+
+
+if __name__ == "__main__":
+    import argparse
+    parser = argparse.ArgumentParser()
+    parser.add_argument("pyramid", help="pyramid file written by main --pyramid")
+    parser.add_argument("--max-points", type=int, default=2000, help="entries drawn per view")
+    args = parser.parse_args()
+
+    view(Pyramid(args.pyramid), args.max_points)
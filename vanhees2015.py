@@ -7,6 +7,7 @@ https://journals.plos.org/plosone/article?id=10.1371/journal.pone.0142533
 
 """
 
+import glob
 import os
 import numpy as np
 import matplotlib.pyplot as plt
@@ -42,13 +43,11 @@ def stimuli(subject, data_dir):
     t = ti
 
     # zero-order hold on truth data (assume truth data has a new sample each time subject state has
-    # changed, holding the previous value until then)
-    truth_interp = np.zeros(N)
+    # changed, holding the previous value until then): each sample gets the last label before it
+    idx = np.searchsorted(truth[:, 0], t, side="left") - 1
+    truth_interp = truth[np.clip(idx, 0, None), 1]
     truth_interp[0] = truth[0, 1]
 
-    for i in range(1, N):
-        truth_interp[i] = truth[truth[:, 0] < t[i]][-1][1]  # there's probably a nicer way to do this...
-
     # we now have accelerometer data (axi, ayi, azi) and truth data (truth_interp) with the same time
     # axis (t)
     ret = np.zeros((N, 5))
@@ -61,6 +60,35 @@ def stimuli(subject, data_dir):
     return ret
 
 
+def cached_stimuli(subject, data_dir, cache_dir):
+    """Same as stimuli(), but the result is cached as a .npy file in <cache_dir> and memory-mapped
+    read-only on later calls. The cache is keyed by subject and the modification times of the
+    source files, so it is rebuilt when they change.
+
+    """
+
+    sources = [os.path.join(data_dir, "motion", f"{subject}_acceleration.txt"),
+               os.path.join(data_dir, "labels", f"{subject}_labeled_sleep.txt")]
+    key = "_".join(str(os.stat(source).st_mtime_ns) for source in sources)
+    path = os.path.join(cache_dir, f"{subject}_stimuli_{key}.npy")
+
+    if not os.path.exists(path):
+        stim = stimuli(subject, data_dir)
+
+        # drop caches built from older versions of the source files
+        os.makedirs(cache_dir, exist_ok=True)
+        for stale in glob.glob(os.path.join(cache_dir, f"{subject}_stimuli_*.npy")):
+            os.remove(stale)
+
+        # write under a temporary name so an interrupted run never leaves a partial cache
+        tmp = f"{path}.{os.getpid()}.tmp"
+        with open(tmp, "wb") as f:
+            np.save(f, stim)
+        os.replace(tmp, path)
+
+    return np.load(path, mmap_mode="r")
+
+
 # exponential moving average
 def ema(x, y, eta):
     return y + eta*(x - y)
@@ -156,18 +184,8 @@ def vanhees2015_modified(stim):
     return np.array(ret), dbg
 
 
-if __name__ == "__main__":
-    import argparse
-    parser = argparse.ArgumentParser()
-    parser.add_argument("--subject", required=True)
-    parser.add_argument("-o", "--outfile")
-    parser.add_argument("--data-dir", default="data")
-    args = parser.parse_args()
-
-    # seems to work well with subject 5498603
-    # 4426783 has good example with some easy to see classification errors
-    stim = stimuli(args.subject, args.data_dir)
-    ret, dbg = vanhees2015_modified(stim)
+def plot(stim, ret, dbg):
+    """Plot input, intermediate values and estimated state against truth."""
 
     truth_binary = stim[:, 4].copy()
     truth_binary[truth_binary > 1] = 1
@@ -213,6 +231,126 @@ if __name__ == "__main__":
     for ax in [ax_ang, ax_ang_change]:
         ax.set_ylabel("Angle [deg]")
 
+    return fig
+
+
+def load_stimuli(subject, data_dir, cache_dir):
+    if cache_dir is None:
+        return stimuli(subject, data_dir)
+    return cached_stimuli(subject, data_dir, cache_dir)
+
+
+def estimate_per_sample(stim, ret):
+    """Hold each estimated state from <ret> until the next one, to get one estimate per sample."""
+    idx = np.searchsorted(ret[:, 0], stim[:, 0], side="right") - 1
+    return ret[np.clip(idx, 0, None), 1]
+
+
+def run_subject(subject, data_dir, cache_dir, figure_dir):
+    """Worker for --subjects: run the algorithm on one subject, save its figure and return the
+    per-sample estimate and binary truth (-1 unscored, 0 wake, 1 sleep) through shared memory.
+    The caller attaches to and unlinks the returned block.
+
+    """
+
+    from multiprocessing import shared_memory
+
+    stim = load_stimuli(subject, data_dir, cache_dir)
+    ret, dbg = vanhees2015_modified(stim)
+
+    fig = plot(stim, ret, dbg)
+    fig.savefig(os.path.join(figure_dir, f"{subject}.png"))
+    plt.close(fig)
+
+    N = len(stim)
+    shm = shared_memory.SharedMemory(create=True, size=max(2*N, 1))
+    result = np.ndarray((2, N), dtype=np.int8, buffer=shm.buf)
+    result[0] = estimate_per_sample(stim, ret)
+    result[1] = np.clip(stim[:, 4], -1, 1)
+    del result
+    shm.close()
+
+    return subject, shm.name, N
+
+
+def run_subjects(subjects, data_dir, cache_dir, figure_dir, jobs):
+    """Run several subjects in a process pool and print a table of per-subject and total
+    accuracy.
+
+    """
+
+    from concurrent.futures import ProcessPoolExecutor, as_completed
+    from multiprocessing import shared_memory
+
+    plt.switch_backend("Agg")
+    os.makedirs(figure_dir, exist_ok=True)
+
+    rows = []
+    total = np.zeros((2, 2), dtype=np.int64)  # [truth, estimate]
+    with ProcessPoolExecutor(max_workers=jobs) as pool:
+        futures = [pool.submit(run_subject, subject, data_dir, cache_dir, figure_dir) for subject in subjects]
+        for future in as_completed(futures):
+            subject, name, N = future.result()
+            shm = shared_memory.SharedMemory(name=name)
+            try:
+                result = np.ndarray((2, N), dtype=np.int8, buffer=shm.buf)
+                scored = result[1] >= 0
+                counts = np.zeros((2, 2), dtype=np.int64)
+                np.add.at(counts, (result[1][scored], result[0][scored]), 1)
+                del result, scored
+            finally:
+                shm.close()
+                shm.unlink()
+
+            total += counts
+            rows.append((subject, counts))
+
+    def fmt(subject, counts):
+        n = counts.sum()
+        acc = 100*np.trace(counts)/n if n else np.nan
+        sens = 100*counts[1, 1]/counts[1].sum() if counts[1].sum() else np.nan
+        spec = 100*counts[0, 0]/counts[0].sum() if counts[0].sum() else np.nan
+        return f"{subject:>12} {n:>10} {acc:>9.1f} {sens:>12.1f} {spec:>12.1f}"
+
+    print(f"{'subject':>12} {'samples':>10} {'accuracy':>9} {'sensitivity':>12} {'specificity':>12}")
+    for subject, counts in sorted(rows):
+        print(fmt(subject, counts))
+    print(fmt("all", total))
+
+
+if __name__ == "__main__":
+    import argparse
+    parser = argparse.ArgumentParser()
+    group = parser.add_mutually_exclusive_group(required=True)
+    group.add_argument("--subject")
+    group.add_argument("--subjects", nargs="+",
+                       help="run several subjects in parallel, or \"all\" for every subject in DATA_DIR")
+    parser.add_argument("-o", "--outfile")
+    parser.add_argument("--data-dir", default="data")
+    parser.add_argument("--cache-dir", help="where to cache preprocessed data (default: DATA_DIR/cache)")
+    parser.add_argument("--no-cache", action="store_true", help="always preprocess from the source files")
+    parser.add_argument("--figure-dir", default="figures", help="where to save per-subject figures with --subjects")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count(), help="worker processes for --subjects")
+    args = parser.parse_args()
+
+    cache_dir = None if args.no_cache else (args.cache_dir or os.path.join(args.data_dir, "cache"))
+
+    if args.subjects:
+        subjects = args.subjects
+        if subjects == ["all"]:
+            suffix = "_acceleration.txt"
+            subjects = sorted(f[:-len(suffix)] for f in os.listdir(os.path.join(args.data_dir, "motion"))
+                              if f.endswith(suffix))
+        run_subjects(subjects, args.data_dir, cache_dir, args.figure_dir, args.jobs)
+        raise SystemExit
+
+    # seems to work well with subject 5498603
+    # 4426783 has good example with some easy to see classification errors
+    stim = load_stimuli(args.subject, args.data_dir, cache_dir)
+    ret, dbg = vanhees2015_modified(stim)
+
+    plot(stim, ret, dbg)
+
     if args.outfile:
         plt.savefig(args.outfile)
     else: